@@ -1,5 +1,7 @@
 
 import java.io.File;
+import java.util.ArrayList;
+import java.util.List;
 import java.util.Objects;
 import javax.inject.Inject;
 import org.gradle.api.*;
@@ -7,6 +9,7 @@ import org.gradle.api.file.DirectoryProperty;
 import org.gradle.api.file.FileCollection;
 import org.gradle.api.file.FileSystemOperations;
 import org.gradle.api.file.RegularFileProperty;
+import org.gradle.api.provider.ListProperty;
 import org.gradle.api.provider.Property;
 import org.gradle.api.tasks.Input;
 import org.gradle.api.tasks.InputFiles;
@@ -32,23 +35,48 @@ abstract public class ParallelTestTask extends DefaultTask implements Task {
   abstract Property<FileCollection> getDumps();
   @OutputDirectory
   abstract DirectoryProperty getReportDir();
-  @Input
+  @Input @Optional
   abstract Property<Long> getChunkSize();
   @Internal
   abstract Property<Boolean> getUseSlurm();
   @Input @Optional
   abstract Property<Boolean> getTrace();
+  // file extension of the traces, "vcd" or "fst"
+  @Input @Optional
+  abstract Property<String> getTraceFormat();
   @Internal
   abstract Property<Long> getSlurmJobId();
+  @Input @Optional
+  abstract Property<Integer> getWorkers();
+  @Input @Optional
+  abstract ListProperty<String> getHarnessArgs();
+  @Input @Optional
+  abstract Property<Boolean> getCheckpoint();
+  @Input @Optional
+  abstract Property<Boolean> getArchive();
+  // unchanged chunks are served from here (see TestCache)
+  @Internal
+  abstract DirectoryProperty getCacheDir();
+  // the model and harness files the results depend on besides the dumps
+  @InputFiles @Optional
+  abstract Property<FileCollection> getCacheKeyFiles();
+  // the flags those files are built into the harness with
+  @Input @Optional
+  abstract ListProperty<String> getCacheKeyFlags();
   
   @TaskAction
   public void submitTests() {
     WorkQueue workQueue = executor.noIsolation();
+    String modelHash = getCacheDir().isPresent() ?
+      TestCache.hashModel(getCacheKeyFiles().get(),
+        getCacheKeyFlags().get()) : null;
     getDumps().get().filter(File::isFile).forEach(dump -> {
       DirectoryProperty reportDir =
         getProject().getObjects().directoryProperty().value(
           getReportDir().dir(dump.getName()));
-      getProject().delete(reportDir);
+      // checkpoints and the reports they resume are kept for a rerun
+      if(!getCheckpoint().getOrElse(false))
+        getProject().delete(reportDir);
       getProject().mkdir(reportDir);
       for(long seek = 0; seek < dump.length();
         seek += getChunkSize().getOrElse(Long.MAX_VALUE)
@@ -62,7 +90,14 @@ abstract public class ParallelTestTask extends DefaultTask implements Task {
           params.getReport().set(reportDir.file(dump.getName() + "_" + _seek));
           params.getUseSlurm().set(getUseSlurm());
           params.getTrace().set(getTrace());
+          params.getTraceFormat().set(getTraceFormat());
           params.getSlurmJobId().set(getSlurmJobId());
+          params.getWorkers().set(getWorkers());
+          params.getHarnessArgs().set(getHarnessArgs());
+          params.getCheckpoint().set(getCheckpoint());
+          params.getArchive().set(getArchive());
+          params.getCacheDir().set(getCacheDir());
+          params.getModelHash().set(modelHash);
         });
       }
     });
@@ -78,7 +113,14 @@ abstract class PTParams implements WorkParameters {
   abstract RegularFileProperty getReport();
   abstract Property<Boolean> getUseSlurm();
   abstract Property<Boolean> getTrace();
+  abstract Property<String> getTraceFormat();
   abstract Property<Long> getSlurmJobId();
+  abstract Property<Integer> getWorkers();
+  abstract ListProperty<String> getHarnessArgs();
+  abstract Property<Boolean> getCheckpoint();
+  abstract Property<Boolean> getArchive();
+  abstract DirectoryProperty getCacheDir();
+  abstract Property<String> getModelHash();
 }
 
 abstract class PTAction implements WorkAction<PTParams> {
@@ -94,6 +136,32 @@ abstract class PTAction implements WorkAction<PTParams> {
   @Override
   public void execute() {
     PTParams params = this.getParameters();
+    String traceFormat = params.getTraceFormat().getOrElse("vcd");
+    String report = params.getReport().get().getAsFile().getPath();
+    List<File> outputs = new ArrayList<>();
+    outputs.add(new File(report));
+    outputs.add(new File(report + ".res"));
+    if(params.getArchive().getOrElse(false))
+      outputs.add(new File(report + ".arc"));
+    // traced runs are for their waveforms, so they are always simulated
+    File cacheEntry = null;
+    if(params.getCacheDir().isPresent() && params.getModelHash().isPresent() &&
+        !params.getTrace().getOrElse(false)) {
+      List<String> options = new ArrayList<>();
+      options.add(params.getExecutable().get());
+      options.add(String.valueOf(params.getWorkers().getOrNull()));
+      options.addAll(params.getHarnessArgs().getOrElse(
+        java.util.Collections.emptyList()));
+      String key = TestCache.chunkKey(params.getModelHash().get(),
+        params.getDump().get().getAsFile(), params.getDumpSeek().get(),
+        params.getDumpLimit().getOrNull(), options);
+      cacheEntry = params.getCacheDir().get().dir(key).getAsFile();
+      if(TestCache.restore(cacheEntry, outputs)) {
+        // a checkpoint of an earlier, interrupted run is no longer needed
+        new File(report + ".ckpt").delete();
+        return;
+      }
+    }
     if(params.getUseSlurm().getOrElse(false)) {
       try {
         Thread.sleep(
@@ -112,6 +180,8 @@ abstract class PTAction implements WorkAction<PTParams> {
           e.args("--time", "12:00:00"); // 12-hour time limit
           e.args("--job-name", "ASIC DEFLATE test");
         }
+        if(params.getWorkers().isPresent())
+          e.args("--cpus-per-task", params.getWorkers().get().toString());
         e.args("--quiet");
         e.args(params.getExecutable().get());
       } else {
@@ -123,9 +193,23 @@ abstract class PTAction implements WorkAction<PTParams> {
       if(params.getDumpLimit().isPresent())
         e.args("--dump-limit", params.getDumpLimit().get());
       e.args("--report", params.getReport().get());
+      // the summary task merges these rather than parsing the reports
+      e.args("--results", params.getReport().get() + ".res");
+      if(params.getWorkers().isPresent())
+        e.args("--workers", params.getWorkers().get());
+      e.args(params.getHarnessArgs().getOrElse(java.util.Collections.emptyList()));
       if(params.getTrace().getOrElse(false)) {
-        e.args("--c-trace", params.getReport().get() + "_c.vcd");
-        e.args("--d-trace", params.getReport().get() + "_d.vcd");
+        e.args("--c-trace", params.getReport().get() + "_c." + traceFormat);
+        e.args("--d-trace", params.getReport().get() + "_d." + traceFormat);
+      }
+      if(params.getArchive().getOrElse(false))
+        e.args("--archive", params.getReport().get() + ".arc");
+      if(params.getCheckpoint().getOrElse(false)) {
+        // the harness deletes the checkpoint once the run completes
+        String checkpoint = params.getReport().get() + ".ckpt";
+        e.args("--checkpoint", checkpoint);
+        if(new File(checkpoint).isFile())
+          e.args("--resume", checkpoint);
       }
       e.setIgnoreExitValue(true);
     });
@@ -135,9 +219,13 @@ abstract class PTAction implements WorkAction<PTParams> {
         " : seek = " + params.getDumpSeek().get() +
         " : exit = " + (byte)res.getExitValue());
     } else {
+      if(cacheEntry != null)
+        TestCache.store(cacheEntry, outputs);
       if(params.getTrace().getOrElse(false)) {
-        fsOps.delete(s -> s.delete(params.getReport().get() + "_c.vcd"));
-        fsOps.delete(s -> s.delete(params.getReport().get() + "_d.vcd"));
+        fsOps.delete(s -> s.delete(params.getReport().get() + "_c." +
+          traceFormat));
+        fsOps.delete(s -> s.delete(params.getReport().get() + "_d." +
+          traceFormat));
       }
     }
     res.assertNormalExitValue();
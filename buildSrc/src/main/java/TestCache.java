@@ -0,0 +1,161 @@
+
+import java.io.File;
+import java.io.IOException;
+import java.io.RandomAccessFile;
+import java.nio.charset.StandardCharsets;
+import java.nio.file.DirectoryNotEmptyException;
+import java.nio.file.FileAlreadyExistsException;
+import java.nio.file.Files;
+import java.nio.file.StandardCopyOption;
+import java.security.MessageDigest;
+import java.security.NoSuchAlgorithmException;
+import java.util.ArrayList;
+import java.util.Comparator;
+import java.util.List;
+
+/**
+ * Results of test chunks, keyed by everything they depend on: the bytes of the
+ * chunk, the files of the model and harness (generated Verilog, parameters
+ * and harness sources), the flags they were built with, and the options of
+ * the run. A chunk whose key is in
+ * the cache is not simulated again; its report and results files are copied
+ * from the cache. Only passing runs are stored.
+ */
+class TestCache {
+  private TestCache() {}
+  
+  private static MessageDigest digest() {
+    try {
+      return MessageDigest.getInstance("SHA-256");
+    } catch(NoSuchAlgorithmException ex) {
+      throw new RuntimeException(ex);
+    }
+  }
+  
+  private static String hex(byte[] hash) {
+    StringBuilder sb = new StringBuilder();
+    for(byte b : hash)
+      sb.append(String.format("%02x", b));
+    return sb.toString();
+  }
+  
+  private static void update(MessageDigest md, String s) {
+    md.update(s.getBytes(StandardCharsets.UTF_8));
+    md.update((byte)0);
+  }
+  
+  /**
+   * Hash of the names and contents of some files, in any order, and of the
+   * flags they are built into a harness with.
+   */
+  public static String hashModel(Iterable<File> files, List<String> flags) {
+    List<File> sorted = new ArrayList<>();
+    files.forEach(sorted::add);
+    sorted.sort(Comparator.comparing(File::getPath));
+    MessageDigest md = digest();
+    for(String flag : flags)
+      update(md, flag);
+    // the files start after a separator no flag contains
+    md.update((byte)1);
+    try {
+      for(File f : sorted) {
+        update(md, f.getName());
+        md.update(Files.readAllBytes(f.toPath()));
+      }
+    } catch(IOException ex) {
+      throw new RuntimeException(ex);
+    }
+    return hex(md.digest());
+  }
+  
+  /**
+   * Key of a chunk of `limit` bytes (or up to the end, if null) from `seek`
+   * in `dump`, for a model and harness with hash `modelHash` run with
+   * `options`.
+   */
+  public static String chunkKey(String modelHash, File dump, long seek,
+      Long limit, List<String> options) {
+    MessageDigest md = digest();
+    update(md, modelHash);
+    // reports name the dump
+    update(md, dump.getName());
+    update(md, Long.toString(seek));
+    update(md, String.valueOf(limit));
+    for(String option : options)
+      update(md, option);
+    try(RandomAccessFile in = new RandomAccessFile(dump, "r")) {
+      in.seek(seek);
+      long remaining = limit != null ? limit : Long.MAX_VALUE;
+      byte[] buf = new byte[1 << 20];
+      while(remaining > 0) {
+        int n = in.read(buf, 0, (int)Math.min(buf.length, remaining));
+        if(n < 0)
+          break;
+        md.update(buf, 0, n);
+        remaining -= n;
+      }
+    } catch(IOException ex) {
+      throw new RuntimeException(ex);
+    }
+    return hex(md.digest());
+  }
+  
+  /**
+   * Copy the cached files of `entry` to `outputs` (same names, in order).
+   * Returns false, copying nothing, if the entry lacks any of them.
+   */
+  public static boolean restore(File entry, List<File> outputs) {
+    for(File out : outputs)
+      if(!new File(entry, out.getName()).isFile())
+        return false;
+    try {
+      for(File out : outputs)
+        Files.copy(new File(entry, out.getName()).toPath(), out.toPath(),
+          StandardCopyOption.REPLACE_EXISTING);
+    } catch(IOException ex) {
+      throw new RuntimeException(ex);
+    }
+    return true;
+  }
+  
+  /**
+   * Store the files of a finished run as `entry`. The entry only appears once
+   * it is complete, so an interrupted store leaves no partial entry. An entry
+   * that already exists, from an earlier or concurrent run of the same chunk,
+   * is kept; its files are the same.
+   */
+  public static void store(File entry, List<File> outputs) {
+    if(entry.isDirectory())
+      return;
+    File tmp = null;
+    try {
+      entry.getParentFile().mkdirs();
+      // unique, so concurrent stores of one entry do not share it
+      tmp = Files.createTempDirectory(entry.getParentFile().toPath(),
+        entry.getName() + ".tmp").toFile();
+      for(File out : outputs)
+        Files.copy(out.toPath(), new File(tmp, out.getName()).toPath(),
+          StandardCopyOption.REPLACE_EXISTING);
+      Files.move(tmp.toPath(), entry.toPath(),
+        StandardCopyOption.ATOMIC_MOVE);
+      tmp = null;
+    } catch(FileAlreadyExistsException | DirectoryNotEmptyException ex) {
+      // another run stored it first
+    } catch(IOException ex) {
+      // a run whose results cannot be cached still passes
+      System.err.println("Cannot cache " + entry + ": " + ex);
+    } finally {
+      if(tmp != null)
+        deleteFlat(tmp);
+    }
+  }
+  
+  /** Delete a directory of plain files. */
+  private static void deleteFlat(File dir) {
+    File[] files = dir.listFiles();
+    if(files != null)
+      for(File f : files)
+        f.delete();
+    dir.delete();
+  }
+}
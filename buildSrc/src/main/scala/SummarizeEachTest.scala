@@ -1,16 +1,20 @@
-
-import java.io.{PrintWriter}
-import java.nio.file.Files
+import java.io.{File, IOException, PrintWriter, RandomAccessFile}
+import java.nio.{ByteBuffer, ByteOrder}
+import java.nio.channels.FileChannel
+import java.nio.charset.StandardCharsets
 import org.gradle.api._
 import org.gradle.api.file.DirectoryProperty
 import org.gradle.api.tasks.InputDirectory
 import org.gradle.api.tasks.OutputDirectory
 import org.gradle.api.tasks.TaskAction
-import scala.io.Source
+import scala.jdk.CollectionConverters._
 import scala.util.Using
 
+// Merges the results files (`--results`, see src/test/cpp/Results.h) of each
+// bench into a text summary and a JSON summary. Only the summary section of
+// each file is read.
 abstract class SummarizeEachTest extends DefaultTask {
-  
+
   @InputDirectory
   def getReportDir: DirectoryProperty
   @OutputDirectory
@@ -23,81 +27,19 @@ abstract class SummarizeEachTest extends DefaultTask {
     // TODO: issue warning when File.listFiles returs null
     getReportDir.getAsFile.get.listFiles(_.isDirectory).foreach { bench =>
       val benchSummary = bench.listFiles
-      .filter(!_.getName().endsWith(".vcd"))
-      .map { reportFile =>
-        Using(Source.fromFile(reportFile)) { source => Some(source.getLines())
-          .map(_.dropWhile(_ != "***** SUMMARY *****").splitAt(1))
-          .flatMap(s =>
-            if(s._1.exists(_ == "***** SUMMARY *****"))
-              Some(s._2)
-            else {
-              System.err.println(s"warning: $reportFile: no summary section");
-              None
-            }
-          )
-          .map(_
-            .flatMap{l =>
-              def wbad = System.err.println(s"warning: $reportFile: " +
-                s"bad summary line: '$l'")
-              val d = l.split(":").map(_.trim)
-              if(d.lengthIs != 2) {
-                wbad
-                None
-              } else d(0) match {
-                case
-                  "dumps" |
-                  "total (bytes)" |
-                  "total (pages)" |
-                  "non-zero (bytes)" |
-                  "non-zero (pages)" |
-                  "passed (pages)" |
-                  "failed (pages)" |
-                  "pass rate" |
-                  "compressed (bits)" |
-                  "compression ratio" |
-                  "C-cycles" |
-                  "C-throughput (B/c)" |
-                  "D-cycles" |
-                  "D-throughput (B/c)"
-                  => Some((d(0), d(1)))
-                case _ => {
-                  wbad
-                  None
-                }
-              }
-            }
-            .toMap
-            .map{case (k, v) => (k, Some(v))}
-            .withDefault{k =>
-              System.err.println(s"warning: $reportFile: missing key: $k")
-              None
-            }
-          )
+      .filter(_.getName().endsWith(".res"))
+      .flatMap { resultFile =>
+        Using(new RandomAccessFile(resultFile, "r")) { file =>
+          Summary.read(resultFile, file.getChannel)
         }
         .recover { ex =>
-          System.err.println(s"Warning: $reportFile: " +
-            "An error occured while reading the report file.")
+          System.err.println(s"Warning: $resultFile: " +
+            "An error occured while reading the results file.")
           ex.printStackTrace()
           None
         }
         .get
-        .map{l => Summary(
-          dumps = l("dumps").map(_.split("\\s*,\\s*").toSet)
-            .getOrElse(Set.empty),
-          totalSize = l("total (bytes)").map(_.toLong).getOrElse(0),
-          totalPages = l("total (pages)").map(_.toInt).getOrElse(0),
-          nonzeroSize = l("non-zero (bytes)").map(_.toLong).getOrElse(0),
-          nonzeroPages = l("non-zero (pages)").map(_.toInt).getOrElse(0),
-          passedPages = l("passed (pages)").map(_.toInt).getOrElse(0),
-          failedPages = l("failed (pages)").map(_.toInt).getOrElse(0),
-          compressedSize = l("compressed (bits)").map(_.toLong).getOrElse(0),
-          compressorCycles = l("C-cycles").map(_.toLong).getOrElse(0),
-          compressorStalls = 0,
-          decompressorCycles = l("D-cycles").map(_.toLong).getOrElse(0),
-          decompressorStalls = 0
-        )}
       }
-      .flatten
       .fold(Summary.empty)(_ + _)
       
       Using(
@@ -105,61 +47,361 @@ abstract class SummarizeEachTest extends DefaultTask {
       ) { out =>
         benchSummary.print(out)
       }
+      Using(
+        new PrintWriter(
+          getSummaryDir.file(bench.getName + ".json").get.getAsFile)
+      ) { out =>
+        benchSummary.printJson(out)
+      }
     }
   }
 }
+object SummarizeEachTest {
+  // The summary lines of one results file by name, as the harness reports
+  // them, for build scripts that run the harness themselves.
+  def readSummary(resultFile: File): java.util.Map[String, Any] =
+    Using(new RandomAccessFile(resultFile, "r")) { file =>
+      Summary.read(resultFile, file.getChannel)
+    }
+    .get
+    .getOrElse(throw new GradleException(s"$resultFile: no results summary"))
+    .entries.toMap.asJava
+}
 
+// Log-linear latency histogram, bucketed as in Results.h
+private case class Histogram(max: Long, buckets: Vector[Long]) {
+  def +(that: Histogram): Histogram = Histogram(
+    max = this.max.max(that.max),
+    buckets = this.buckets.lazyZip(that.buckets).map(_ + _)
+  )
+  
+  // nearest rank, capped at the maximum as in the test harness
+  def percentile(p: Int): Long = {
+    val rank = (buckets.sum * p + 99) / 100
+    if(rank == 0) 0L
+    else {
+      val b = buckets.scanLeft(0L)(_ + _).indexWhere(_ >= rank) - 1
+      Histogram.bucketHigh(b).min(max)
+    }
+  }
+}
+private object Histogram {
+  val subBits = 5
+  val bucketCount = 64 + (64 - 6) * 32
+  
+  // largest value that falls in a bucket
+  def bucketHigh(b: Int): Long =
+    if(b < 64) b
+    else {
+      val e = (b - 64) / 32 + 6
+      ((32L + (b - 64) % 32) << (e - subBits)) + (1L << (e - subBits)) - 1
+    }
+  
+  val empty = Histogram(0, Vector.fill(bucketCount)(0L))
+}
+
+// The pages of one stratum of `--sample`, and the sums of each measure and of
+// its square over the sampled ones (ResultStratum in Results.h)
+private case class Stratum(
+  pages: Long,
+  sampled: Long,
+  sum: Vector[Double],
+  sumSq: Vector[Double]
+) {
+  def +(that: Stratum): Stratum = Stratum(
+    pages = this.pages + that.pages,
+    sampled = this.sampled + that.sampled,
+    sum = this.sum.lazyZip(that.sum).map(_ + _),
+    sumSq = this.sumSq.lazyZip(that.sumSq).map(_ + _)
+  )
+}
+private object Stratum {
+  // compressed bits, compressor cycles and decompressor cycles
+  val measures = 3
+  
+  val empty = Stratum(0, 0, Vector.fill(measures)(0.0),
+    Vector.fill(measures)(0.0))
+}
+
+// `stages` names the compressor stages whose occupancy follows the RESULT_*
+// counters, RESULT_CYCLE_KINDS counters each; `strata` are those of
+// `--sample`, none without it
 private case class Summary(
   dumps: Set[String],
-  totalSize: Long,
-  totalPages: Int, 
-  nonzeroSize: Long,
-  nonzeroPages: Int,
-  compressedSize: Long,
-  passedPages: Int,
-  failedPages: Int,
-  compressorCycles: Long,
-  compressorStalls: Long,
-  decompressorCycles: Long,
-  decompressorStalls: Long
+  pageSizes: Set[Long],
+  stages: Seq[String],
+  counters: Vector[Long],
+  latency: Vector[Histogram],
+  strata: Vector[Stratum]
 ) {
+  import Summary._
+  
+  // the files of a bench come from one harness, so they share their stages
+  // (the empty summary has none)
   def +(that: Summary): Summary = Summary(
     dumps = this.dumps ++ that.dumps,
-    totalSize = this.totalSize + that.totalSize,
-    totalPages = this.totalPages + that.totalPages,
-    nonzeroSize = this.nonzeroSize + that.nonzeroSize,
-    nonzeroPages = this.nonzeroPages + that.nonzeroPages,
-    compressedSize = this.compressedSize + that.compressedSize,
-    passedPages = this.passedPages + that.passedPages,
-    failedPages = this.failedPages + that.failedPages,
-    compressorCycles = this.compressorCycles + that.compressorCycles,
-    compressorStalls = this.compressorStalls + that.compressorStalls,
-    decompressorCycles = this.decompressorCycles + that.decompressorCycles,
-    decompressorStalls = this.decompressorStalls + that.decompressorStalls
+    pageSizes = this.pageSizes ++ that.pageSizes,
+    stages = if(this.stages.nonEmpty) this.stages else that.stages,
+    counters = this.counters.zipAll(that.counters, 0L, 0L).map(_ + _),
+    latency = this.latency.lazyZip(that.latency).map(_ + _),
+    strata = this.strata.zipAll(that.strata, Stratum.empty, Stratum.empty)
+      .map{case (a, b) => a + b}
   )
   
+  // Estimate the total of a measure over all non-zero pages from the sampled
+  // ones (stratified expansion estimator, as in the harness), and the
+  // variance of the estimate.
+  def estimateTotal(m: Int): (Double, Double) =
+    strata.filter(_.sampled > 0).foldLeft((0.0, 0.0)) {
+      case ((total, variance), s) =>
+        val n = s.sampled.doubleValue
+        val pages = s.pages.doubleValue
+        val mean = s.sum(m) / n
+        val v = if(n > 1) (s.sumSq(m) - n * mean * mean) / (n - 1) else 0.0
+        (total + pages * mean,
+          variance + (if(v > 0) pages * pages * (1 - n / pages) * v / n
+            else 0.0))
+    }
+  
+  // the SAMPLING section of the harness, computed from the merged strata
+  def samplingEntries: Seq[(String, Any)] = {
+    def c(i: Int) = counters(i)
+    // the bytes of every page are known, so the rates are those bytes over
+    // the estimated bits and cycles
+    val bytes = (c(NonzeroSize) + c(UnsampledSize)).doubleValue
+    Seq(
+      "strata" -> strata.length,
+      "sampled (pages)" -> c(NonzeroPages),
+      "unsampled (pages)" -> c(UnsampledPages),
+      "unsampled (bytes)" -> c(UnsampledSize),
+      "sampled fraction" -> c(NonzeroPages).doubleValue /
+        (c(NonzeroPages) + c(UnsampledPages))
+    ) ++
+    sampleMeasures.zipWithIndex.flatMap{case ((total, rate, scale), m) =>
+      val (estimate, variance) = estimateTotal(m)
+      val margin = sampleZ * math.sqrt(variance)
+      val scaled = scale * bytes
+      // the upper end of the total is the lower end of the rate
+      Seq(
+        s"estimated $total" -> estimate,
+        s"estimated $rate" -> scaled / estimate,
+        s"$rate CI low" -> scaled / (estimate + margin),
+        s"$rate CI high" ->
+          (if(estimate > margin) scaled / (estimate - margin)
+            else Double.PositiveInfinity)
+      )
+    } ++
+    strata.zipWithIndex.flatMap{case (s, h) => Seq(
+      s"stratum $h (pages)" -> s.pages,
+      s"stratum $h sampled (pages)" -> s.sampled
+    )}
+  }
+  
+  // the summary lines of the test harness, in order
+  def entries: Seq[(String, Any)] = {
+    def c(i: Int) = counters(i)
+    def ratio(a: Long, b: Long) = a.doubleValue / b
+    Seq(
+      "total (bytes)" -> c(TotalSize),
+      "total (pages)" -> c(TotalPages),
+      "non-zero (bytes)" -> c(NonzeroSize),
+      "non-zero (pages)" -> c(NonzeroPages),
+      "passed (pages)" -> c(PassedPages),
+      "failed (pages)" -> c(FailedPages),
+      "pass rate" -> ratio(c(PassedPages), c(NonzeroPages)),
+      "compressed (bits)" -> c(CompressedSize),
+      "compression ratio" -> ratio(c(NonzeroSize), c(CompressedSize)) * 8,
+      "duplicate (pages)" -> c(DuplicatePages),
+      "reused (pages)" -> c(ReusedPages),
+      "dedup ratio" ->
+        ratio(c(NonzeroPages), c(NonzeroPages) - c(DuplicatePages)),
+      "dedup hit rate" -> ratio(c(ReusedPages), c(NonzeroPages)),
+      "aborted (pages)" -> c(AbortedPages),
+      "abort rate" -> ratio(c(AbortedPages), c(NonzeroPages)),
+      "aborted (bytes)" -> c(AbortedSize),
+      "aborted output (bits)" -> c(AbortedBits),
+      "C-cycles saved (estimate)" -> c(EstimatedSavedCycles),
+      "same-value (pages)" -> c(SamePages),
+      "same-value (bytes)" -> c(SameSize),
+      "same-value footprint (bits)" -> c(SameBits),
+      "same-value C-cycles" -> c(SameCompressorCycles),
+      "same-value D-cycles" -> c(SameDecompressorCycles),
+      "C-cycles" -> c(CompressorCycles),
+      "C-throughput (B/c)" -> ratio(c(NonzeroSize), c(CompressorCycles)),
+      "D-cycles" -> c(DecompressorCycles),
+      "D-throughput (B/c)" -> ratio(c(NonzeroSize), c(DecompressorCycles)),
+      "C-sim speed (cycles/s)" ->
+        ratio(c(CompressorCycles), c(CompressorHostNs)) * 1e9,
+      "D-sim speed (cycles/s)" ->
+        ratio(c(DecompressorCycles), c(DecompressorHostNs)) * 1e9
+    ) ++
+    cycleKinds.zipWithIndex.map{case (k, i) =>
+      s"C-$k (cycles)" -> c(CompressorKinds + i)} ++
+    cycleKinds.zipWithIndex.map{case (k, i) =>
+      s"D-$k (cycles)" -> c(DecompressorKinds + i)} ++
+    stages.zipWithIndex.flatMap{case (s, j) =>
+      cycleKinds.zipWithIndex.map{case (k, i) =>
+        s"C-$s-$k (cycles)" -> c(counterCount + j * cycleKinds.length + i)}} ++
+    Seq("C", "D").zip(latency).flatMap{case (m, h) =>
+      percentiles.map(p => s"$m-latency p$p (cycles)" -> h.percentile(p)) :+
+        (s"$m-latency max (cycles)" -> h.max)
+    } ++
+    (if(strata.nonEmpty) samplingEntries else Seq.empty)
+  }
+  
   def print(sink: PrintWriter): Unit = {
     sink.println("***** SUMMARY *****")
     sink.println(s"dumps: ${this.dumps.mkString(",")}")
-    sink.println(s"total (bytes): ${this.totalSize}")
-    sink.println(s"total (pages): ${this.totalPages}")
-    sink.println(s"non-zero (bytes): ${this.nonzeroSize}")
-    sink.println(s"non-zero (pages): ${this.nonzeroPages}")
-    sink.println(s"passed (pages): ${this.passedPages}")
-    sink.println(s"failed (pages): ${this.failedPages}")
-    sink.println(s"pass rate: " +
-      s"${this.passedPages.doubleValue / this.nonzeroPages}")
-    sink.println(s"compressed (bits): ${this.compressedSize}")
-    sink.println(s"compression ratio: " +
-      s"${this.nonzeroSize.doubleValue / this.compressedSize * 8}")
-    sink.println(s"C-cycles: ${this.compressorCycles}")
-    sink.println(s"C-throughput (B/c): " +
-      s"${this.nonzeroSize.doubleValue / this.compressorCycles}")
-    sink.println(s"D-cycles: ${this.decompressorCycles}")
-    sink.println(s"D-throughput (B/c): " +
-      s"${this.nonzeroSize.doubleValue / this.decompressorCycles}")
+    sink.println(s"page size (bytes): ${this.pageSizes.mkString(",")}")
+    entries.foreach{case (k, v) => sink.println(s"$k: $v")}
+  }
+  
+  def printJson(sink: PrintWriter): Unit = {
+    def str(s: String) = "\"" + s.flatMap{
+      case '"' => "\\\""
+      case '\\' => "\\\\"
+      case c if c < ' ' => "\\u%04x".format(c.toInt)
+      case c => c.toString
+    } + "\""
+    def value(v: Any) = v match {
+      case d: Double if d.isNaN || d.isInfinite => "null"
+      case v => v.toString
+    }
+    sink.println("{")
+    sink.print(s"  ${str("dumps")}: [${this.dumps.map(str).mkString(", ")}]")
+    sink.print(s",\n  ${str("page size (bytes)")}: " +
+      s"[${this.pageSizes.mkString(", ")}]")
+    entries.foreach{case (k, v) =>
+      sink.print(s",\n  ${str(k)}: ${value(v)}")
+    }
+    sink.println("\n}")
   }
 }
 private object Summary {
-  object empty extends Summary(Set.empty, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+  // file format and counter order of Results.h
+  val magic = "DFRESULT"
+  val version = 10
+  val TotalSize = 0
+  val TotalPages = 1
+  val NonzeroSize = 2
+  val NonzeroPages = 3
+  val CompressedSize = 4
+  val PassedPages = 5
+  val FailedPages = 6
+  val CompressorCycles = 7
+  val DecompressorCycles = 8
+  val cycleKinds = Seq("busy", "starved", "backpressured", "idle")
+  val CompressorKinds = 9
+  val DecompressorKinds = CompressorKinds + cycleKinds.length
+  val CompressorHostNs = DecompressorKinds + cycleKinds.length
+  val DecompressorHostNs = CompressorHostNs + 1
+  val DuplicatePages = DecompressorHostNs + 1
+  val ReusedPages = DuplicatePages + 1
+  val AbortedPages = ReusedPages + 1
+  val AbortedSize = AbortedPages + 1
+  val AbortedBits = AbortedSize + 1
+  val EstimatedSavedCycles = AbortedBits + 1
+  val SamePages = EstimatedSavedCycles + 1
+  val SameSize = SamePages + 1
+  val SameBits = SameSize + 1
+  val SameCompressorCycles = SameBits + 1
+  val SameDecompressorCycles = SameCompressorCycles + 1
+  val UnsampledPages = SameDecompressorCycles + 1
+  val UnsampledSize = UnsampledPages + 1
+  val counterCount = UnsampledSize + 1
+  val histogramCount = 2
+  
+  val percentiles = Seq(50, 90, 99)
+  // the estimates of `--sample`: total, rate and the scale of the rate's
+  // bytes, per measure
+  val sampleMeasures = Seq(
+    ("compressed (bits)", "compression ratio", 8.0),
+    ("C-cycles", "C-throughput (B/c)", 1.0),
+    ("D-cycles", "D-throughput (B/c)", 1.0))
+  // two-sided 95% quantile of the normal distribution
+  val sampleZ = 1.96
+  
+  val empty = Summary(Set.empty, Set.empty, Seq.empty,
+    Vector.fill(counterCount)(0L), Vector.fill(histogramCount)(Histogram.empty),
+    Vector.empty)
+  
+  // The summary of one results file, or None (with a warning) when the file
+  // is incomplete or of another format version.
+  def read(file: File, channel: FileChannel): Option[Summary] = {
+    def warn(msg: String) = {
+      System.err.println(s"warning: $file: $msg")
+      None
+    }
+    def buffer(offset: Long, len: Int): ByteBuffer = {
+      val buf = ByteBuffer.allocate(len).order(ByteOrder.LITTLE_ENDIAN)
+      var eof = false
+      while(buf.hasRemaining && !eof)
+        eof = channel.read(buf, offset + buf.position()) < 0
+      if(buf.hasRemaining)
+        throw new IOException(s"$file: unexpected end of file")
+      buf.flip()
+      buf
+    }
+    def isMagic(buf: ByteBuffer) = {
+      val bytes = new Array[Byte](magic.length)
+      buf.get(bytes)
+      new String(bytes, StandardCharsets.US_ASCII) == magic
+    }
+    
+    val size = channel.size
+    if(size < 36)
+      return warn("no summary section")
+    val header = buffer(0, 20)
+    val footer = buffer(size - 16, 16)
+    val offset = footer.getLong
+    if(!isMagic(header) || !isMagic(footer))
+      return warn("no summary section")
+    if(header.getInt != version)
+      return warn("unknown format version")
+    val pageSize = header.getInt.toLong & 0xffffffffL
+    val dumpLength = header.getInt
+    val dump = new String(buffer(20, dumpLength).array,
+      StandardCharsets.UTF_8)
+    // the compressor stages, each a length and a name
+    var pos = 20L + dumpLength
+    val stages = Vector.fill(buffer(pos, 4).getInt) {
+      val length = buffer(pos + 4, 4).getInt
+      val name = new String(buffer(pos + 8, length).array,
+        StandardCharsets.UTF_8)
+      pos += 4 + length
+      name
+    }
+    
+    val count = counterCount + stages.length * cycleKinds.length
+    val counts = buffer(offset, 4)
+    if(counts.getInt != count)
+      return warn("unexpected number of counters")
+    val counterBuf = buffer(offset + 4, 8 * count + 8)
+    val counters = Vector.fill(count)(counterBuf.getLong)
+    if(counterBuf.getInt != histogramCount ||
+        counterBuf.getInt != Histogram.bucketCount)
+      return warn("unexpected histogram layout")
+    val histLength = 8 * (1 + Histogram.bucketCount) * histogramCount
+    val histBuf = buffer(offset + 12 + 8 * count, histLength)
+    val latency = Vector.fill(histogramCount) {
+      val max = histBuf.getLong
+      Histogram(max, Vector.fill(Histogram.bucketCount)(histBuf.getLong))
+    }
+    // the strata of `--sample` follow the histograms
+    val strataOffset = offset + 12 + 8 * count + histLength
+    val strataCounts = buffer(strataOffset, 8)
+    val strataCount = strataCounts.getInt
+    if(strataCounts.getInt != Stratum.measures)
+      return warn("unexpected number of sampling measures")
+    val strataBuf = buffer(strataOffset + 8,
+      (16 + 16 * Stratum.measures) * strataCount)
+    val strata = Vector.fill(strataCount) {
+      val pages = strataBuf.getLong
+      val sampled = strataBuf.getLong
+      val sums = Vector.fill(Stratum.measures)(
+        (strataBuf.getLong.doubleValue, strataBuf.getLong.doubleValue))
+      Stratum(pages, sampled, sums.map(_._1), sums.map(_._2))
+    }
+    Some(Summary(Set(dump), Set(pageSize), stages, counters, latency, strata))
+  }
 }
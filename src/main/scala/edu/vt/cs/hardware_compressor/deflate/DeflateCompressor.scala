@@ -3,8 +3,9 @@ package edu.vt.cs.hardware_compressor.deflate
 import chisel3._
 import chisel3.util._
 import edu.vt.cs.hardware_compressor.huffman.{
-  HuffmanCompressor,HuffmanDecompressor}
-import edu.vt.cs.hardware_compressor.lz.{LZCompressor,LZDecompressor}
+  HuffmanCompressor,HuffmanCompressorDebug,HuffmanDecompressor}
+import edu.vt.cs.hardware_compressor.lz.{
+  LZCompressor,LZCompressorDebug,LZDecompressor}
 import edu.vt.cs.hardware_compressor.util._
 import edu.vt.cs.hardware_compressor.util.WidthOps._
 import java.io.PrintWriter
@@ -18,6 +19,8 @@ class DeflateCompressor(params: Parameters) extends Module {
       UInt(params.characterBits.W)))
     val out = RestartableDecoupledStream(params.compressorBitsOut, Bool())
   })
+  val debug = IO(Output(new DeflateCompressorDebug))
+  val abort = IO(new AbortControl)
   
   
   val lz = Module(new LZCompressor(params.lz))
@@ -46,6 +49,20 @@ class DeflateCompressor(params: Parameters) extends Module {
   lz.reset := reset.asBool || huffman.io.in.restart
   io.in.restart := huffman.io.in.restart
   huffman.io.out.restart := io.out.restart
+  
+  // the output of the Huffman stage is the compressed page
+  lz.abort.limit := 0.U
+  huffman.abort.limit := abort.limit
+  abort.aborted := huffman.abort.aborted
+  
+  debug.lz := lz.debug
+  debug.huffman := huffman.debug
+}
+
+// occupancy of the pipeline stages of both compressors (see StageState)
+class DeflateCompressorDebug extends Bundle {
+  val lz = new LZCompressorDebug
+  val huffman = new HuffmanCompressorDebug
 }
 
 object DeflateCompressor extends App {
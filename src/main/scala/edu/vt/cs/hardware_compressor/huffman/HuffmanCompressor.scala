@@ -18,6 +18,8 @@ class HuffmanCompressor(params: Parameters) extends Module {
       UInt(params.characterBits.W)))
     val out = RestartableDecoupledStream(params.compressorBitsOut, Bool())
   })
+  val debug = IO(Output(new HuffmanCompressorDebug))
+  val abort = IO(new AbortControl)
   
   
   // DECLARE PIPELINE INFRASTRUCTURE
@@ -123,6 +125,9 @@ class HuffmanCompressor(params: Parameters) extends Module {
     when(!active) {
       counterReady := params.compressorCharsIn.U
     }
+    
+    debug.counter := StageState(active, inbufLen === 0.U,
+      finished && !transferNext)
   }
   
   
@@ -154,7 +159,8 @@ class HuffmanCompressor(params: Parameters) extends Module {
     }
     
     // TG reset may lag behind others, so don't use TG results during this time.
-    when(treeGeneratorFinished && RegNext(true.B, false.B)) { 
+    val encoding = treeGeneratorFinished && RegNext(true.B, false.B)
+    when(encoding) {
       val encoder =
         withReset(!treeGeneratorFinished || transfer || reset.asBool) {
           Module(new Encoder(params))
@@ -171,6 +177,30 @@ class HuffmanCompressor(params: Parameters) extends Module {
       io.out.last := false.B
       finished := false.B
     }
+    
+    // early abort: bits of the page output so far, and whether they have
+    // passed the limit, after which the page's output ends at once and the
+    // rest of its replay is dropped by the restart
+    val outBits = RegInit(UInt(AbortControl.limitWidth.W), 0.U)
+    val abortedReg = RegInit(Bool(), false.B)
+    val aborted = abortedReg || AbortControl.exceeded(abort.limit, outBits)
+    abortedReg := aborted
+    when(encoding) {
+      outBits := outBits + (io.out.valid min io.out.ready)
+    }
+    when(aborted) {
+      accRep.io.out.ready := 0.U
+      io.out.valid := 0.U
+      io.out.last := true.B
+      finished := true.B
+    }
+    abort.aborted := aborted && active
+    
+    // the tree generator holds its result until the page leaves the stage
+    debug.treeGenerator := StageState(active, false.B, encoding)
+    debug.encoder := StageState(active,
+      !encoding || !finished && accRep.io.out.valid === 0.U,
+      encoding && (finished && !transferNext || io.out.valid > io.out.ready))
   }
   // make sure outputs have a reasonable default when stage 2 is inactive
   when(!active) {
@@ -188,6 +218,13 @@ class HuffmanCompressor(params: Parameters) extends Module {
   transfer := io.out.restart // && io.out.last && io.out.valid <= io.out.ready
 }
 
+// occupancy of the pipeline stages (see StageState)
+class HuffmanCompressorDebug extends Bundle {
+  val counter = UInt(StageState.width.W)
+  val treeGenerator = UInt(StageState.width.W)
+  val encoder = UInt(StageState.width.W)
+}
+
 object HuffmanCompressor extends App {
   val params = Parameters.fromCSV(Path.of("configFiles/huffman.csv"))
   params.print()
@@ -11,6 +11,11 @@ class LZCompressor(params: Parameters) extends Module {
   val io = IO(new StreamBundle(
     params.compressorCharsIn, UInt(params.characterBits.W),
     params.compressorCharsOut, UInt(params.characterBits.W)))
+  val debug = IO(Output(new LZCompressorDebug))
+  // Counts the output since reset, not per page: like the CAM, the abort
+  // state is only cleared by resetting the module, which must happen between
+  // pages (the LZ harness and DeflateCompressor both do).
+  val abort = IO(new AbortControl)
   
   val cam = Module(new CAM(params))
   val encoder = Module(new Encoder(params))
@@ -86,6 +91,36 @@ class LZCompressor(params: Parameters) extends Module {
     (!encoder.io.working ||
       (cam.io.litOut.valid === 0.U && cam.io.matchLength === 0.U)) &&
     outLitCount +& encoder.io.out.valid <= params.compressorCharsOut.U
+  
+  // early abort: characters of the page output so far, and whether their
+  // bits have passed the limit, after which the output ends at once and no
+  // more input is taken; both are cleared by the reset before the next page
+  val outChars = RegInit(UInt(AbortControl.limitWidth.W), 0.U)
+  val abortedReg = RegInit(false.B)
+  val aborted = abortedReg ||
+    AbortControl.exceeded(abort.limit, outChars * params.characterBits.U)
+  abortedReg := aborted
+  outChars := outChars + (io.out.valid min io.out.ready)
+  when(aborted) {
+    cam.io.charsIn.valid := 0.U
+    io.in.ready := 0.U
+    io.out.valid := 0.U
+    io.out.finished := true.B
+  }
+  abort.aborted := aborted
+  
+  // occupancy of the CAM and the encoder; the CAM is held back while the
+  // encoder works or the output does not take its literals
+  debug.cam := StageState(!cam.io.finished, io.in.valid === 0.U,
+    cam.io.litOut.ready < cam.io.litOut.valid || !cam.io.matchReady)
+  debug.encoder := StageState(encoder.io.working, false.B,
+    encoder.io.out.ready < encoder.io.out.valid)
+}
+
+// occupancy of the pipeline stages (see StageState)
+class LZCompressorDebug extends Bundle {
+  val cam = UInt(StageState.width.W)
+  val encoder = UInt(StageState.width.W)
 }
 
 object LZCompressor extends App {
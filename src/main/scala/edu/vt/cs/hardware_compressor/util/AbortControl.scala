@@ -0,0 +1,23 @@
+package edu.vt.cs.hardware_compressor.util
+
+import chisel3._
+
+/**
+ * Early abort of incompressible pages, set by the test harness. Once more
+ * than `limit` bits of a page have been output (never, if `limit` is 0), the
+ * compressor drops the rest of the page and ends its output stream, with
+ * `aborted` asserted until the stream is restarted (or, for modules without a
+ * restart, until they are reset before the next page). The page is then
+ * stored raw instead of compressed.
+ */
+class AbortControl extends Bundle {
+  val limit = Input(UInt(AbortControl.limitWidth.W))
+  val aborted = Output(Bool())
+}
+
+object AbortControl {
+  val limitWidth = 32
+
+  // whether the `bits` output so far pass the limit
+  def exceeded(limit: UInt, bits: UInt): Bool = limit =/= 0.U && bits > limit
+}
@@ -0,0 +1,28 @@
+package edu.vt.cs.hardware_compressor.util
+
+import chisel3._
+import chisel3.util._
+
+/**
+ * What a pipeline stage is doing in a cycle, for the debug ports read by the
+ * test harness. The encoding matches the cycle kinds of the harness
+ * (CYCLE_* in src/test/cpp/Results.h).
+ * - busy: the stage is working on a page
+ * - starved: the stage has a page, but no input to work on
+ * - blocked: the stage has output the next stage does not take, or is done
+ *   with its page and waiting to hand it on
+ * - idle: the stage has no page
+ */
+object StageState {
+  val width = 2
+  val busy = 0
+  val starved = 1
+  val blocked = 2
+  val idle = 3
+  
+  def apply(active: Bool, starved: Bool, blocked: Bool): UInt =
+    MuxCase(this.busy.U(width.W), Seq(
+      !active -> this.idle.U,
+      blocked -> this.blocked.U,
+      starved -> this.starved.U))
+}
@@ -0,0 +1,174 @@
+#ifndef ACCESS_TRACE_H
+#define ACCESS_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Results.h"
+
+// Trace-driven model of the accelerator in a memory system
+// (`--access-trace`). A trace is a text file with one page access per line:
+//
+//   <time in ns> <page index in the dump> <r|w>
+//
+// A read is a page fault, served by a decompressor, and a write a swap-out,
+// served by a compressor. Blank lines and lines starting with `#` are
+// skipped, and the lines need not be in time order. Each access waits for
+// the first of the `instances` modules of its kind to come free (first come,
+// first served) and then takes as many cycles as the simulation of its page
+// did. Accesses to zero pages and to pages bypassed by `--same-pages bypass`
+// never reach the accelerator.
+
+#define ACCESS_READ 0
+#define ACCESS_WRITE 1
+#define ACCESS_KINDS 2
+
+// what the simulation left for a page of the dump
+#define ACCESS_PAGE_UNSEEN 0
+#define ACCESS_PAGE_ZERO 1
+#define ACCESS_PAGE_SIMULATED 2
+// bypassed by `--same-pages bypass`
+#define ACCESS_PAGE_SAME 3
+
+struct AccessPage {
+  uint8_t state;
+  // the cycles of the page in the module serving each kind of access
+  uint32_t cycles[ACCESS_KINDS];
+};
+
+struct Access {
+  double time;
+  int64_t page;
+  int kind;
+  // line in the trace, to keep the order of simultaneous accesses
+  size_t line;
+};
+
+struct AccessStats {
+  // accesses served by the accelerator, and those to zero and bypassed
+  // same-value pages
+  uint64_t served;
+  uint64_t zero;
+  uint64_t same;
+  // cycles the modules spent serving accesses
+  uint64_t busy;
+  struct ResultHistogram queueing;
+  struct ResultHistogram latency;
+};
+
+static inline int at_compare(const void *a, const void *b) {
+  const struct Access *x = (const struct Access*)a;
+  const struct Access *y = (const struct Access*)b;
+  if(x->time != y->time)
+    return x->time < y->time ? -1 : 1;
+  return x->line < y->line ? -1 : x->line > y->line;
+}
+
+// Read a trace into `*accesses` (to be freed), sorted by time. Returns NULL,
+// or why the file cannot be read (`*line` is then the offending line).
+static inline const char *at_read(const char *path, struct Access **accesses,
+    size_t *count, size_t *line) {
+  *accesses = NULL;
+  *count = 0;
+  *line = 0;
+  FILE *file = fopen(path, "r");
+  if(file == NULL)
+    return "cannot open the file";
+  size_t cap = 0;
+  char buf[256];
+  const char *err = NULL;
+  while(err == NULL && fgets(buf, sizeof(buf), file)) {
+    ++*line;
+    char *s = buf + strspn(buf, " \t\r\n");
+    if(*s == '\0' || *s == '#')
+      continue;
+    struct Access access;
+    long long page;
+    char kind[2];
+    if(sscanf(s, "%lf %lld %1s", &access.time, &page, kind) != 3 ||
+        (kind[0] != 'r' && kind[0] != 'w'))
+      err = "expected <time in ns> <page> <r|w>";
+    else if(access.time < 0 || page < 0)
+      err = "negative time or page";
+    if(err != NULL)
+      break;
+    access.page = page;
+    access.kind = kind[0] == 'r' ? ACCESS_READ : ACCESS_WRITE;
+    access.line = *line;
+    if(*count == cap) {
+      size_t newCap = cap ? cap * 2 : 4096;
+      struct Access *grown = (struct Access*)realloc(*accesses,
+        sizeof(struct Access) * newCap);
+      if(grown == NULL) {
+        err = "out of memory";
+        break;
+      }
+      *accesses = grown;
+      cap = newCap;
+    }
+    (*accesses)[(*count)++] = access;
+  }
+  fclose(file);
+  if(err != NULL) {
+    free(*accesses);
+    *accesses = NULL;
+    *count = 0;
+    return err;
+  }
+  qsort(*accesses, *count, sizeof(struct Access), at_compare);
+  return NULL;
+}
+
+// Serve the accesses with `instances` modules of each kind running at
+// `clockMhz`. Accesses to pages the simulation did not reach are counted in
+// `*unknown`. `*span` is the number of cycles from the first access to the
+// last one served.
+static inline void at_simulate(const struct Access *accesses, size_t count,
+    const struct AccessPage *pages, size_t pageCount, int instances,
+    double clockMhz, struct AccessStats stats[ACCESS_KINDS],
+    uint64_t *unknown, uint64_t *span) {
+  memset(stats, 0, sizeof(struct AccessStats) * ACCESS_KINDS);
+  *unknown = 0;
+  *span = 0;
+  // when each module is next free, in cycles since the first access
+  uint64_t *ready = (uint64_t*)calloc(ACCESS_KINDS * instances,
+    sizeof(uint64_t));
+  double start = count ? accesses[0].time : 0;
+  for(size_t i = 0; i < count; i++) {
+    const struct Access *a = &accesses[i];
+    struct AccessStats *s = &stats[a->kind];
+    if(a->page >= (int64_t)pageCount ||
+        pages[a->page].state == ACCESS_PAGE_UNSEEN) {
+      ++*unknown;
+      continue;
+    }
+    if(pages[a->page].state == ACCESS_PAGE_ZERO) {
+      s->zero++;
+      continue;
+    }
+    if(pages[a->page].state == ACCESS_PAGE_SAME) {
+      s->same++;
+      continue;
+    }
+    uint64_t arrival = (a->time - start) * clockMhz / 1000;
+    uint64_t *unit = &ready[a->kind * instances];
+    for(int u = 1; u < instances; u++)
+      if(ready[a->kind * instances + u] < *unit)
+        unit = &ready[a->kind * instances + u];
+    uint64_t begin = *unit > arrival ? *unit : arrival;
+    uint64_t cycles = pages[a->page].cycles[a->kind];
+    *unit = begin + cycles;
+    if(*unit > *span)
+      *span = *unit;
+    s->served++;
+    s->busy += cycles;
+    rh_add(&s->queueing, begin - arrival);
+    rh_add(&s->latency, *unit - arrival);
+  }
+  free(ready);
+}
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "Results.h"
+
+// Archive of the compressed pages of a test run (`--archive`), which
+// `--replay` feeds straight into the decompressor. All integers are little
+// endian. A file is laid out as:
+//
+//   header   "DFARCHIV", u32 version, u32 stream (STREAM_* of the harness
+//            that wrote it), u32 page size, u64 pages and u64 bytes of the
+//            run that are not archived (zero, bypassed, unsampled or aborted
+//            pages), u32 dump name length, dump name
+//   streams  the compressed stream of each page, LSB first and padded to a
+//            whole byte
+//   index    u64 page count, then one entry of ARCHIVE_ENTRY_SIZE bytes per
+//            page: i64 id, u64 stream offset, u64 compressed bits, u32 raw
+//            size, u64 raw hash low and high (hashPage in PageScan.h), u32
+//            compressor cycles, u32 compressor cycles of each kind and u32
+//            compressor share of each kind (RESULT_CYCLE_KINDS each)
+//   footer   u64 offset of the index, "DFARCHIV"
+//
+// The raw pages are not kept; replayed pages are checked against their hash.
+
+#define ARCHIVE_VERSION 3
+#define ARCHIVE_MAGIC "DFARCHIV"
+#define ARCHIVE_ENTRY_SIZE (8 + 8 + 8 + 4 + 16 + 4 + 8 * RESULT_CYCLE_KINDS)
+// where the counts of pages not archived are, filled in on close
+#define ARCHIVE_UNARCHIVED_OFFSET 20
+// header without a dump name, page count and footer
+#define ARCHIVE_MIN_SIZE (ARCHIVE_UNARCHIVED_OFFSET + 16 + 4 + 8 + 16)
+
+struct ArchivePage {
+  int64_t id;
+  uint64_t offset;
+  uint64_t compressedBits;
+  uint32_t rawSize;
+  uint64_t hashLo;
+  uint64_t hashHi;
+  uint32_t compressorCycles;
+  uint32_t compressorKinds[RESULT_CYCLE_KINDS];
+  // the page's share of the compressor's total cycles (see TestDeflate.cpp)
+  uint32_t compressorShareKinds[RESULT_CYCLE_KINDS];
+};
+
+struct ArchiveWriter {
+  FILE *file;
+  uint64_t offset;
+  // index entries, written at the end
+  struct ArchivePage *pages;
+  size_t count;
+  size_t cap;
+  // the index could not grow or a write failed; later pages are dropped and
+  // the file is left without an index
+  bool failed;
+};
+
+static inline void aw_put(struct ArchiveWriter *w, uint64_t v, int bytes) {
+  uint8_t buf[8];
+  for(int i = 0; i < bytes; i++)
+    buf[i] = v >> (8 * i);
+  fwrite(buf, 1, bytes, w->file);
+  w->offset += bytes;
+}
+
+// false if the file cannot be created
+static inline bool aw_open(struct ArchiveWriter *w, const char *path,
+    int stream, uint32_t pageSize, const char *dump) {
+  w->file = fopen(path, "wb");
+  if(w->file == NULL)
+    return false;
+  w->offset = 0;
+  w->pages = NULL;
+  w->count = 0;
+  w->cap = 0;
+  w->failed = false;
+  fwrite(ARCHIVE_MAGIC, 1, 8, w->file);
+  w->offset += 8;
+  aw_put(w, ARCHIVE_VERSION, 4);
+  aw_put(w, stream, 4);
+  aw_put(w, pageSize, 4);
+  aw_put(w, 0, 8);
+  aw_put(w, 0, 8);
+  aw_put(w, strlen(dump), 4);
+  fwrite(dump, 1, strlen(dump), w->file);
+  w->offset += strlen(dump);
+  return true;
+}
+
+// Append the stream of a page, (compressedBits + 7) / 8 bytes of `data`. The
+// offset of `page` is filled in. False if the index cannot grow or the stream
+// cannot be written, after which the writer has failed.
+static inline bool aw_page(struct ArchiveWriter *w,
+    const struct ArchivePage *page, const uint8_t *data) {
+  if(w->failed)
+    return false;
+  if(w->count == w->cap) {
+    size_t cap = w->cap ? w->cap * 2 : 1024;
+    struct ArchivePage *pages = (struct ArchivePage*)realloc(w->pages,
+      sizeof(struct ArchivePage) * cap);
+    if(pages == NULL) {
+      w->failed = true;
+      return false;
+    }
+    w->pages = pages;
+    w->cap = cap;
+  }
+  struct ArchivePage *entry = &w->pages[w->count++];
+  *entry = *page;
+  entry->offset = w->offset;
+  size_t len = (page->compressedBits + 7) / 8;
+  if(fwrite(data, 1, len, w->file) != len) {
+    w->failed = true;
+    return false;
+  }
+  w->offset += len;
+  return true;
+}
+
+// Write out the buffered streams and return the end of them so far, from
+// which aw_resume continues the file.
+static inline uint64_t aw_sync(struct ArchiveWriter *w) {
+  fflush(w->file);
+  return w->offset;
+}
+
+// Continue a file of an interrupted run after the streams up to `offset` (see
+// aw_sync), which hold the first `count` pages. The caller fills in their
+// index entries. False if the file cannot be opened.
+static inline bool aw_resume(struct ArchiveWriter *w, const char *path,
+    uint64_t offset, size_t count) {
+  w->file = fopen(path, "r+b");
+  if(w->file == NULL)
+    return false;
+  w->offset = offset;
+  w->count = count;
+  w->cap = count > 1024 ? count : 1024;
+  w->failed = false;
+  w->pages = (struct ArchivePage*)malloc(sizeof(struct ArchivePage) * w->cap);
+  if(w->pages == NULL) {
+    fclose(w->file);
+    return false;
+  }
+  return !ftruncate(fileno(w->file), offset) &&
+    !fseek(w->file, offset, SEEK_SET);
+}
+
+// Write the index and the `pages` and `size` bytes of the run that are not
+// archived, and close the file. False if the writer has failed or a write
+// did, in which case the file is closed without an index (or with a partial
+// one, which ar_check rejects).
+static inline bool aw_close(struct ArchiveWriter *w, uint64_t pages,
+    uint64_t size) {
+  // a stream cut short by a full disk must not get a valid footer
+  if(w->failed || ferror(w->file)) {
+    fclose(w->file);
+    w->file = NULL;
+    free(w->pages);
+    w->pages = NULL;
+    return false;
+  }
+  uint64_t index = w->offset;
+  aw_put(w, w->count, 8);
+  for(size_t i = 0; i < w->count; i++) {
+    const struct ArchivePage *p = &w->pages[i];
+    aw_put(w, p->id, 8);
+    aw_put(w, p->offset, 8);
+    aw_put(w, p->compressedBits, 8);
+    aw_put(w, p->rawSize, 4);
+    aw_put(w, p->hashLo, 8);
+    aw_put(w, p->hashHi, 8);
+    aw_put(w, p->compressorCycles, 4);
+    for(int k = 0; k < RESULT_CYCLE_KINDS; k++)
+      aw_put(w, p->compressorKinds[k], 4);
+    for(int k = 0; k < RESULT_CYCLE_KINDS; k++)
+      aw_put(w, p->compressorShareKinds[k], 4);
+  }
+  aw_put(w, index, 8);
+  fwrite(ARCHIVE_MAGIC, 1, 8, w->file);
+  fseek(w->file, ARCHIVE_UNARCHIVED_OFFSET, SEEK_SET);
+  aw_put(w, pages, 8);
+  aw_put(w, size, 8);
+  bool ok = !ferror(w->file);
+  ok = !fclose(w->file) && ok;
+  w->file = NULL;
+  free(w->pages);
+  w->pages = NULL;
+  return ok;
+}
+
+// A whole archive mapped read-only; pages are read in place.
+struct ArchiveReader {
+  const uint8_t *map;
+  size_t size;
+  const uint8_t *index;
+  size_t count;
+  // the page size of the run that wrote the archive, and its pages that are
+  // not archived
+  uint32_t pageSize;
+  uint64_t unarchivedPages;
+  uint64_t unarchivedSize;
+};
+
+static inline uint64_t ar_get(const uint8_t *p, int bytes) {
+  uint64_t v = 0;
+  for(int i = 0; i < bytes; i++)
+    v |= (uint64_t)p[i] << (8 * i);
+  return v;
+}
+
+// Check the header, footer and index of a mapped archive. Returns NULL, or
+// why it cannot be replayed.
+static inline const char *ar_check(struct ArchiveReader *r, int stream) {
+  const uint8_t *footer = r->map + r->size - 16;
+  uint64_t index = ar_get(footer, 8);
+  if(memcmp(r->map, ARCHIVE_MAGIC, 8) || memcmp(footer + 8, ARCHIVE_MAGIC, 8))
+    return "not an archive (or an incomplete one)";
+  if(ar_get(r->map + 8, 4) != ARCHIVE_VERSION)
+    return "unknown format version";
+  if(ar_get(r->map + 12, 4) != (uint64_t)stream)
+    return "written by the harness of another stream";
+  r->pageSize = ar_get(r->map + 16, 4);
+  r->unarchivedPages = ar_get(r->map + ARCHIVE_UNARCHIVED_OFFSET, 8);
+  r->unarchivedSize = ar_get(r->map + ARCHIVE_UNARCHIVED_OFFSET + 8, 8);
+  // ARCHIVE_MIN_SIZE keeps this from wrapping, unlike `index + 8`
+  if(index > r->size - 24)
+    return "corrupt index";
+  r->count = ar_get(r->map + index, 8);
+  r->index = r->map + index + 8;
+  if(r->count > (r->size - 16 - index - 8) / ARCHIVE_ENTRY_SIZE)
+    return "corrupt index";
+  return NULL;
+}
+
+// Map an archive written by the harness for `stream`. Returns NULL, or why
+// the file cannot be replayed, in which case nothing stays mapped.
+static inline const char *ar_open(struct ArchiveReader *r, const char *path,
+    int stream) {
+  int fd = open(path, O_RDONLY);
+  if(fd < 0)
+    return "cannot open the file";
+  struct stat st;
+  void *map = MAP_FAILED;
+  if(!fstat(fd, &st) && st.st_size >= ARCHIVE_MIN_SIZE)
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping stays valid without the descriptor
+  close(fd);
+  if(map == MAP_FAILED)
+    return "not an archive";
+  r->map = (const uint8_t*)map;
+  r->size = st.st_size;
+  
+  const char *err = ar_check(r, stream);
+  if(err != NULL) {
+    munmap(map, r->size);
+    r->map = NULL;
+  }
+  return err;
+}
+
+static inline void ar_page(const struct ArchiveReader *r, size_t i,
+    struct ArchivePage *page) {
+  const uint8_t *p = r->index + i * ARCHIVE_ENTRY_SIZE;
+  page->id = ar_get(p, 8);
+  page->offset = ar_get(p + 8, 8);
+  page->compressedBits = ar_get(p + 16, 8);
+  page->rawSize = ar_get(p + 24, 4);
+  page->hashLo = ar_get(p + 28, 8);
+  page->hashHi = ar_get(p + 36, 8);
+  page->compressorCycles = ar_get(p + 44, 4);
+  p += 48;
+  for(int k = 0; k < RESULT_CYCLE_KINDS; k++, p += 4)
+    page->compressorKinds[k] = ar_get(p, 4);
+  for(int k = 0; k < RESULT_CYCLE_KINDS; k++, p += 4)
+    page->compressorShareKinds[k] = ar_get(p, 4);
+}
+
+// the stream of a page, or NULL if it lies outside the file
+static inline const uint8_t *ar_data(const struct ArchiveReader *r,
+    const struct ArchivePage *page) {
+  if(page->offset > r->size || (page->compressedBits + 7) / 8 >
+      r->size - page->offset)
+    return NULL;
+  return r->map + page->offset;
+}
+
+static inline void ar_close(struct ArchiveReader *r) {
+  munmap((void*)r->map, r->size);
+}
+
+#endif
@@ -0,0 +1,205 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <chrono>
+#include <thread>
+#include "BitQueue.h"
+#include "PageScan.h"
+#include "SoftDeflate.h"
+#include "SoftDeflateConfig.h"
+
+// Measures the throughput of the software codec on the non-zero pages of
+// memory dumps and checks that every page survives a round trip.
+
+// default page size (see `--page-size`)
+#define PAGE_SIZE 4096
+#define REPEAT 3
+
+
+struct {
+  const char *config;
+  size_t pageSize;
+  int threads;
+  int repeat;
+} options;
+
+static struct Dump *dumps;
+static int dumpCount;
+static struct SoftDeflatePage *pages;
+static const uint8_t **raw;
+// pages that failed either way, so each is counted once
+static bool *failed;
+static size_t pageCount;
+
+
+// best wall time of `options.repeat` runs, in seconds
+static double timeBatch(const struct SoftDeflateParams *params,
+    void (*batch)(const struct SoftDeflateParams*, struct SoftDeflatePage*,
+      size_t, int)) {
+  double best = 0;
+  for(int r = 0; r < options.repeat; r++) {
+    auto start = std::chrono::steady_clock::now();
+    batch(params, pages, pageCount, options.threads);
+    std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+    if(r == 0 || elapsed.count() < best)
+      best = elapsed.count();
+  }
+  return best;
+}
+
+int main(int argc, const char **argv) {
+  options.config = "configFiles/deflate.csv";
+  options.pageSize = PAGE_SIZE;
+  options.threads = std::thread::hardware_concurrency();
+  options.repeat = REPEAT;
+  dumps = (struct Dump*)malloc(sizeof(struct Dump) * argc);
+  dumpCount = 0;
+  for(int i = 1; i < argc; i++) {
+    if(!strcmp(argv[i], "--config")) {
+      ++i;
+      assert(i < argc);
+      options.config = argv[i];
+    }
+    else if(!strcmp(argv[i], "--dump")) {
+      ++i;
+      assert(i < argc);
+      if(!openDump(&dumps[dumpCount++], argv[i]))
+        return 127;
+    }
+    else if(!strcmp(argv[i], "--page-size")) {
+      ++i;
+      assert(i < argc);
+      options.pageSize = atol(argv[i]);
+      assert(options.pageSize > 0);
+    }
+    else if(!strcmp(argv[i], "--threads")) {
+      ++i;
+      assert(i < argc);
+      options.threads = atoi(argv[i]);
+      if(options.threads <= 0)
+        options.threads = std::thread::hardware_concurrency();
+      assert(options.threads > 0);
+    }
+    else if(!strcmp(argv[i], "--repeat")) {
+      ++i;
+      assert(i < argc);
+      options.repeat = atoi(argv[i]);
+      assert(options.repeat > 0);
+    }
+    else {
+      fprintf(stderr, "error: unknown option %s\n", argv[i]);
+      return 127;
+    }
+  }
+  struct Config config;
+  if(!loadConfig(&config, options.config))
+    return 127;
+  checkPageSize(&config, options.pageSize);
+  if(!dumpCount) {
+    fprintf(stderr, "error: no --dump given\n");
+    return 127;
+  }
+  
+  // collect the non-zero pages of all dumps
+  size_t maxPages = 0;
+  for(int i = 0; i < dumpCount; i++)
+    maxPages += (dumps[i].size + options.pageSize - 1) / options.pageSize;
+  pages = (struct SoftDeflatePage*)malloc(
+    sizeof(struct SoftDeflatePage) * (maxPages ? maxPages : 1));
+  raw = (const uint8_t**)malloc(sizeof(uint8_t*) * (maxPages ? maxPages : 1));
+  failed = (bool*)calloc(maxPages ? maxPages : 1, sizeof(bool));
+  assert(pages != NULL && raw != NULL && failed != NULL);
+  pageCount = 0;
+  size_t nonzeroSize = 0;
+  for(int i = 0; i < dumpCount; i++) {
+    for(size_t offset = 0; offset < dumps[i].size;
+        offset += options.pageSize) {
+      const uint8_t *data = dumps[i].map + offset;
+      size_t len = dumps[i].size - offset < options.pageSize ?
+        dumps[i].size - offset : options.pageSize;
+      if(isZeroPage(data, len))
+        continue;
+      struct SoftDeflatePage *page = &pages[pageCount];
+      raw[pageCount++] = data;
+      // only read by compression
+      page->data = (uint8_t*)data;
+      page->len = len;
+      page->cap = len;
+      bq_init(&page->compressed);
+      nonzeroSize += len;
+    }
+  }
+  
+  double compressTime = timeBatch(&config.params, sd_compressBatch);
+  size_t compressedSize = 0;
+  int failedPages = 0;
+  for(size_t i = 0; i < pageCount; i++) {
+    compressedSize += bq_size(&pages[i].compressed);
+    if(pages[i].err) {
+      failed[i] = true;
+      if(failedPages++ < 10)
+        fprintf(stderr, "page %lu: compression failed: %s\n", i,
+          sd_strerror(pages[i].err));
+    }
+  }
+  
+  uint8_t *decompressed = (uint8_t*)malloc(options.pageSize * (pageCount ?
+    pageCount : 1));
+  for(size_t i = 0; i < pageCount; i++) {
+    pages[i].data = decompressed + i * options.pageSize;
+    pages[i].cap = options.pageSize;
+  }
+  size_t *lens = (size_t*)malloc(sizeof(size_t) * (pageCount ?
+    pageCount : 1));
+  for(size_t i = 0; i < pageCount; i++)
+    lens[i] = pages[i].len;
+  double decompressTime = timeBatch(&config.params, sd_decompressBatch);
+  for(size_t i = 0; i < pageCount; i++) {
+    // a page that did not compress is already counted
+    if(!failed[i] && (pages[i].err || pages[i].len != lens[i] ||
+        memcmp(pages[i].data, raw[i], lens[i]))) {
+      failed[i] = true;
+      if(failedPages++ < 10)
+        fprintf(stderr, "page %lu: round trip failed: %s\n", i,
+          sd_strerror(pages[i].err));
+    }
+  }
+  
+  double gb = nonzeroSize / 1e9;
+  printf("\n***** SUMMARY *****\n");
+  printf("config: %s\n", options.config);
+  printf("dumps:");
+  for(int i = 0; i < dumpCount; i++)
+    printf(" %s", dumps[i].path);
+  printf("\n");
+  printf("page size (bytes): %lu\n", options.pageSize);
+  printf("non-zero (bytes): %lu\n", nonzeroSize);
+  printf("non-zero (pages): %lu\n", pageCount);
+  printf("failed (pages): %d\n", failedPages);
+  printf("compressed (bits): %lu\n", compressedSize);
+  printf("compression ratio: %f\n", (double)nonzeroSize / compressedSize * 8);
+  printf("threads: %d\n", options.threads);
+  printf("compress (GB/s): %f\n", gb / compressTime);
+  printf("compress per core (GB/s): %f\n",
+    gb / compressTime / options.threads);
+  printf("decompress (GB/s): %f\n", gb / decompressTime);
+  printf("decompress per core (GB/s): %f\n",
+    gb / decompressTime / options.threads);
+  
+  for(size_t i = 0; i < pageCount; i++)
+    bq_free(&pages[i].compressed);
+  for(int i = 0; i < dumpCount; i++)
+    closeDump(&dumps[i]);
+  free(lens);
+  free(decompressed);
+  free(failed);
+  free(raw);
+  free(pages);
+  free(dumps);
+  return failedPages < 127 ? failedPages : 127;
+}
@@ -4,143 +4,177 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 
 #define ELEM_SIZE 64
+// smallest ring allocated, in words
+#define MIN_CAPACITY 16
 
-// struct BitQueue {
-//   // elements pop from head
-//   // elems point from head to tail
-//   struct BitQueueElem *head;
-//   struct BitQueueElem *tail;
-// 
-//   uint8_t headSize;
-//   uint8_t tailSize;
-// };
-// 
-// struct BitQueueElem {
-//   // head bit in lsb
-//   uint64_t bits;
-//   // points toward tail, or NULL if this is the tail
-//   struct BitQueueElem *next;
-// };
-
-static char pushTailElem(struct BitQueue *queue) {
-  struct BitQueueElem *newelem =
-    (struct BitQueueElem*)malloc(sizeof(struct BitQueueElem));
-  if(!newelem) return -1;
-  newelem->bits = 0;
-  newelem->next = NULL;
+static size_t bitMask(const struct BitQueue *queue) {
+  return queue->capacity * ELEM_SIZE - 1;
+}
+
+static uint64_t lowBits(uint64_t value, int count) {
+  return count < ELEM_SIZE ? value & (((uint64_t)1 << count) - 1) : value;
+}
+
+void bq_init(struct BitQueue *queue) {
+  queue->words = NULL;
+  queue->capacity = 0;
+  queue->head = 0;
+  queue->size = 0;
+}
+
+void bq_free(struct BitQueue *queue) {
+  free(queue->words);
+  bq_init(queue);
+}
+
+void bq_clear(struct BitQueue *queue) {
+  queue->head = 0;
+  queue->size = 0;
+}
+
+char bq_reserve(struct BitQueue *queue, size_t bits) {
+  // The words from the head word to the tail word must not wrap around onto
+  // the head word, or a push would overwrite bits at the head.
+  size_t span = queue->head % ELEM_SIZE + bits;
+  if(span <= queue->capacity * ELEM_SIZE)
+    return 0;
   
-  if(queue->tail) {
-    queue->tail->next = newelem;
-  }
-  else {
-    queue->head = newelem;
-  }
-  queue->tail = newelem;
-  queue->tailSize = 0;
+  size_t capacity = queue->capacity ? queue->capacity * 2 : MIN_CAPACITY;
+  while(capacity * ELEM_SIZE < span)
+    capacity *= 2;
+  uint64_t *words = (uint64_t*)malloc(capacity * sizeof(uint64_t));
+  if(!words) return -1;
+  
+  // unwrap the ring so the head word is first
+  size_t used = (queue->head % ELEM_SIZE + queue->size + ELEM_SIZE - 1) /
+    ELEM_SIZE;
+  size_t first = queue->head / ELEM_SIZE;
+  for(size_t i = 0; i < used; i++)
+    words[i] = queue->words[(first + i) & (queue->capacity - 1)];
   
+  free(queue->words);
+  queue->words = words;
+  queue->capacity = capacity;
+  queue->head %= ELEM_SIZE;
   return 0;
 }
 
-static char pushHeadElem(struct BitQueue *queue) {
-  struct BitQueueElem *newelem =
-    (struct BitQueueElem*)malloc(sizeof(struct BitQueueElem));
-  if(!newelem) return -1;
-  newelem->bits = 0;
-  newelem->next = queue->head;
+char bq_pushBits(struct BitQueue *queue, uint64_t value, int count) {
+  if(!count) return 0;
+  char err = bq_reserve(queue, queue->size + count);
+  if(err) return err;
   
-  if(!queue->tail) {
-    queue->tail = newelem;
-    queue->tailSize = 0;
-  }
-  queue->head = newelem;
-  queue->headSize = 0;
+  size_t pos = (queue->head + queue->size) & bitMask(queue);
+  size_t major = pos / ELEM_SIZE;
+  int minor = pos % ELEM_SIZE;
+  value = lowBits(value, count);
+  
+  uint64_t *word = &queue->words[major];
+  *word = lowBits(*word, minor) | value << minor;
+  if(minor + count > ELEM_SIZE)
+    queue->words[(major + 1) & (queue->capacity - 1)] =
+      value >> (ELEM_SIZE - minor);
   
+  queue->size += count;
   return 0;
 }
 
-static char popElem(struct BitQueue *queue) {
-  struct BitQueueElem *oldelem = queue->head;
-  queue->head = queue->head->next;
-  free(oldelem);
-  if(!queue->head) {
-    queue->tailSize = 0;
-    queue->tail = NULL;
-  }
-  else if(queue->head == queue->tail) {
-    queue->headSize = queue->tailSize;
-  }
-  else {
-    queue->headSize = ELEM_SIZE;
+char bq_peekBits(const struct BitQueue *queue, size_t offset,
+    uint64_t *value, int count) {
+  if(offset + count > queue->size)
+    return 1;
+  if(!count) {
+    *value = 0;
+    return 0;
   }
   
+  size_t pos = (queue->head + offset) & bitMask(queue);
+  size_t major = pos / ELEM_SIZE;
+  int minor = pos % ELEM_SIZE;
+  
+  uint64_t bits = queue->words[major] >> minor;
+  if(minor + count > ELEM_SIZE)
+    bits |= queue->words[(major + 1) & (queue->capacity - 1)] <<
+      (ELEM_SIZE - minor);
+  *value = lowBits(bits, count);
   return 0;
 }
 
-void bq_init(struct BitQueue *queue) {
-  queue->head = queue->tail = NULL;
-  queue->headSize = 0;
-  queue->tailSize = 0;
+char bq_popBits(struct BitQueue *queue, uint64_t *value, int count) {
+  char err = bq_peekBits(queue, 0, value, count);
+  if(err) return err;
+  
+  if(count) {
+    queue->head = (queue->head + count) & bitMask(queue);
+    queue->size -= count;
+  }
+  return 0;
 }
 
 char bq_pushTail(struct BitQueue *queue, bool bit) {
-  if(queue->tailSize == ELEM_SIZE || queue->tail == NULL) {
-    char err = pushTailElem(queue);
-    if(err) return err;
-  }
-  
-  queue->tail->bits |= (uint64_t)(!!bit) << queue->tailSize;
-  queue->tailSize++;
-  if(queue->tail == queue->head)
-    queue->headSize++;
-  
-  return 0;
+  return bq_pushBits(queue, bit, 1);
 }
 
 char bq_pushHead(struct BitQueue *queue, bool bit) {
-  size_t prevsize = bq_size(queue);
-  
-  if(queue->headSize == ELEM_SIZE || queue->head == NULL) {
-    char err = pushHeadElem(queue);
-    if(err) return err;
-  }
-  
-  queue->head->bits <<= 1;
-  queue->head->bits |= !!bit;
-  queue->headSize++;
-  if(queue->head == queue->tail)
-    queue->tailSize++;
+  // the head may move back into the previous word
+  char err = bq_reserve(queue, queue->size + ELEM_SIZE);
+  if(err) return err;
   
+  queue->head = (queue->head - 1) & bitMask(queue);
+  uint64_t *word = &queue->words[queue->head / ELEM_SIZE];
+  uint64_t mask = (uint64_t)1 << queue->head % ELEM_SIZE;
+  *word = bit ? *word | mask : *word & ~mask;
+  queue->size++;
   return 0;
 }
 
 char bq_pop(struct BitQueue *queue, bool *bit) {
-  if(!queue->headSize) {
-    return 1;
+  uint64_t value;
+  char err = bq_popBits(queue, &value, 1);
+  if(err) return err;
+  *bit = value;
+  return 0;
+}
+
+void bq_copyOut(const struct BitQueue *queue, uint8_t *buf) {
+  size_t i = 0;
+  for(; i + ELEM_SIZE <= queue->size; i += ELEM_SIZE) {
+    uint64_t value;
+    bq_peekBits(queue, i, &value, ELEM_SIZE);
+    memcpy(buf + i / 8, &value, 8);
   }
-  
-  *bit = queue->head->bits & 1;
-  queue->head->bits >>= 1;
-  queue->headSize--;
-  if(queue->head == queue->tail)
-    queue->tailSize--;
-  
-  if(!queue->headSize) {
-    popElem(queue);
+  for(; i < queue->size; i += 8) {
+    uint64_t value;
+    int count = queue->size - i < 8 ? queue->size - i : 8;
+    bq_peekBits(queue, i, &value, count);
+    buf[i / 8] = value;
   }
+}
+
+char bq_copyIn(struct BitQueue *queue, const uint8_t *buf, size_t bits) {
+  char err = bq_reserve(queue, queue->size + bits);
+  if(err) return err;
   
+  size_t i = 0;
+  for(; i + ELEM_SIZE <= bits; i += ELEM_SIZE) {
+    uint64_t value;
+    memcpy(&value, buf + i / 8, 8);
+    bq_pushBits(queue, value, ELEM_SIZE);
+  }
+  for(; i < bits; i += 8) {
+    int count = bits - i < 8 ? bits - i : 8;
+    bq_pushBits(queue, buf[i / 8], count);
+  }
   return 0;
 }
 
-bool bq_isEmpty(struct BitQueue *queue) {
-  return !queue->headSize;
+bool bq_isEmpty(const struct BitQueue *queue) {
+  return !queue->size;
 }
 
-size_t bq_size(struct BitQueue *queue) {
-  if(queue->head == queue->tail) return queue->headSize;
-  size_t size = queue->headSize + queue->tailSize;
-  for(struct BitQueueElem *cur = queue->head; (cur = cur->next) != queue->tail;)
-    size += ELEM_SIZE;
-  return size;
+size_t bq_size(const struct BitQueue *queue) {
+  return queue->size;
 }
@@ -5,33 +5,65 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-struct BitQueue {
-  // elements pop from head
-  // elems point from head to tail
-  struct BitQueueElem *head;
-  struct BitQueueElem *tail;
-  
-  uint8_t headSize;
-  uint8_t tailSize;
-};
+#ifdef __cplusplus
+extern "C" {
+#endif
 
-struct BitQueueElem {
-  // head bit in lsb
-  uint64_t bits;
-  // points toward tail, or NULL if this is the tail
-  struct BitQueueElem *next;
+// A queue of bits stored in a ring of 64-bit words. Bits pop from the head
+// and are pushed onto the tail (or, one at a time, onto the head). Bit `i` of
+// the ring is bit `i % 64` of word `i / 64`, so a queue that starts at bit 0
+// of word 0 has the same layout as an LSB-first byte stream.
+struct BitQueue {
+  uint64_t *words;
+  // in words, always zero or a power of two
+  size_t capacity;
+  // position of the head bit in the ring
+  size_t head;
+  // number of bits in the queue
+  size_t size;
 };
 
 extern void bq_init(struct BitQueue *queue);
 
+extern void bq_free(struct BitQueue *queue);
+
+// remove all bits but keep the storage for reuse
+extern void bq_clear(struct BitQueue *queue);
+
+// make room for at least `bits` bits in total
+extern char bq_reserve(struct BitQueue *queue, size_t bits);
+
 extern char bq_pushTail(struct BitQueue *queue, bool bit);
 
 extern char bq_pushHead(struct BitQueue *queue, bool bit);
 
 extern char bq_pop(struct BitQueue *queue, bool *bit);
 
-extern bool bq_isEmpty(struct BitQueue *queue);
+// push the low `count` (<= 64) bits of `value` onto the tail, LSB first
+extern char bq_pushBits(struct BitQueue *queue, uint64_t value, int count);
 
-extern size_t bq_size(struct BitQueue *queue);
+// pop `count` (<= 64) bits from the head into the low bits of `value`
+extern char bq_popBits(struct BitQueue *queue, uint64_t *value, int count);
+
+// read `count` (<= 64) bits starting `offset` bits after the head without
+// removing them
+extern char bq_peekBits(const struct BitQueue *queue, size_t offset,
+  uint64_t *value, int count);
+
+// copy the whole queue into `buf` as an LSB-first byte stream of
+// (size + 7) / 8 bytes
+extern void bq_copyOut(const struct BitQueue *queue, uint8_t *buf);
+
+// push the first `bits` bits of an LSB-first byte stream onto the tail, the
+// reverse of bq_copyOut
+extern char bq_copyIn(struct BitQueue *queue, const uint8_t *buf, size_t bits);
+
+extern bool bq_isEmpty(const struct BitQueue *queue);
+
+extern size_t bq_size(const struct BitQueue *queue);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
@@ -0,0 +1,224 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <vector>
+#include "BitQueue.h"
+#include "SoftDeflate.h"
+#include "SoftDeflateConfig.h"
+
+// Round-trips pages at the edges of the compressed format through the
+// software codec: empty pages, escape characters, matches at each length and
+// distance boundary, incompressible pages and trees the depth limit truncates.
+// Each case must decompress to its page, also as part of a batch, and must
+// overflow a buffer one character short.
+
+#define BATCH_THREADS 4
+
+struct Case {
+  char name[64];
+  std::vector<uint8_t> page;
+};
+
+static std::vector<Case> cases;
+static uint32_t seed;
+
+// a fixed sequence, so that failures reproduce
+static uint8_t nextRandom() {
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+
+static std::vector<uint8_t> &addCase(const char *format, long arg) {
+  cases.emplace_back();
+  snprintf(cases.back().name, sizeof(cases.back().name), format, arg);
+  return cases.back().page;
+}
+
+static void addRandom(std::vector<uint8_t> &page, size_t len) {
+  for(size_t i = 0; i < len; i++)
+    page.push_back(nextRandom());
+}
+
+static void makeCases(const struct SoftDeflateParams *p) {
+  seed = 1;
+  cases.clear();
+  addCase("empty", 0);
+  addCase("one character", 0).push_back('a');
+  addCase("escape character", 0).push_back(p->escapeCharacter);
+  
+  // all escape characters: one long match of escapes
+  addCase("escape characters (%ld bytes)", 4096)
+    .assign(4096, p->escapeCharacter);
+  // escapes between random characters, which the LZ stage must double
+  std::vector<uint8_t> &escapes = addCase("alternating escapes", 0);
+  for(int i = 0; i < 4096; i++)
+    escapes.push_back(i % 2 ? p->escapeCharacter : nextRandom());
+  std::vector<uint8_t> &escapeEnd = addCase("escape at the end", 0);
+  addRandom(escapeEnd, 4095);
+  escapeEnd.push_back(p->escapeCharacter);
+  
+  // A run of `length + 1` characters, i.e. a literal and a match of `length`
+  // at distance 1, around the shortest match, the longest length the header
+  // holds and each step of extra length characters.
+  int lengthMask = (1 << p->minEncodingLengthBits) - 1;
+  std::vector<int> edges = {p->minCharsToEncode};
+  for(int k = 0; k < 3; k++)
+    edges.push_back(p->minCharsToEncode + lengthMask - 1 +
+      k * p->extraCharacterLengthIncrease);
+  for(int edge : edges)
+    for(int length = edge - 1; length <= edge + 1; length++) {
+      std::vector<uint8_t> &page = addCase("match of %ld", length);
+      addRandom(page, 16);
+      page.insert(page.end(), length + 1, 'r');
+      addRandom(page, 16);
+    }
+  // the longest match the LZ stage encodes, and runs that need a second one
+  for(int extra : {-1, 0, 1, p->maxCharsToEncode + 1}) {
+    std::vector<uint8_t> &page = addCase("match of max + %ld", extra);
+    addRandom(page, 16);
+    page.insert(page.end(), p->maxCharsToEncode + extra + 1, 'r');
+    addRandom(page, 16);
+  }
+  
+  // a block repeated at the largest distance the CAM holds, and one further
+  for(int distance = p->camSize - 1; distance <= p->camSize + 1;
+      distance++) {
+    std::vector<uint8_t> &page = addCase("match at distance %ld", distance);
+    addRandom(page, 32);
+    addRandom(page, distance - 32);
+    page.insert(page.end(), page.begin(), page.begin() + 32);
+  }
+  
+  addRandom(addCase("incompressible (%ld bytes)", 4096), 4096);
+  addRandom(addCase("incompressible (%ld bytes)", 4093), 4093);
+  addRandom(addCase("incompressible (%ld bytes)", 3 * p->passOneSize + 1),
+    3 * p->passOneSize + 1);
+  
+  // more distinct characters than codes
+  std::vector<uint8_t> &all = addCase("every character", 0);
+  for(int i = 0; i < 4096; i++)
+    all.push_back(i);
+  // Frequencies halving from one character to the next give a tree as deep
+  // as there are characters, which the depth limit truncates.
+  std::vector<uint8_t> &skewed = addCase("skewed frequencies", 0);
+  for(int c = 0; c < 24; c++)
+    skewed.insert(skewed.end(), (4096 >> c) / 2 + 1, 'A' + c);
+  for(size_t i = skewed.size() - 1; i > 0; i--)
+    std::swap(skewed[i], skewed[(nextRandom() << 8 | nextRandom()) % (i + 1)]);
+}
+
+// Round-trip a case on its own. Returns whether it passed.
+static bool checkCase(const struct SoftDeflateParams *params,
+    struct SoftDeflateScratch *scratch, const Case *c, size_t *bits) {
+  const std::vector<uint8_t> &page = c->page;
+  struct BitQueue compressed;
+  bq_init(&compressed);
+  int err = sd_compress(params, scratch, page.data(), page.size(),
+    &compressed);
+  *bits = bq_size(&compressed);
+  bool pass = true;
+  if(err) {
+    fprintf(stderr, "%s: compression failed: %s\n", c->name,
+      sd_strerror(err));
+    pass = false;
+  }
+  
+  std::vector<uint8_t> out(page.size() + 1);
+  size_t len = 0;
+  if(pass) {
+    err = sd_decompress(params, &compressed, out.data(), page.size(), &len);
+    if(err || len != page.size() || memcmp(out.data(), page.data(), len)) {
+      fprintf(stderr, "%s: round trip failed: %s\n", c->name,
+        err ? sd_strerror(err) : "output differs");
+      pass = false;
+    }
+  }
+  if(pass && page.size()) {
+    err = sd_decompress(params, &compressed, out.data(), page.size() - 1,
+      &len);
+    if(err != SD_OVERFLOW) {
+      fprintf(stderr, "%s: no overflow one character short\n", c->name);
+      pass = false;
+    }
+  }
+  bq_free(&compressed);
+  return pass;
+}
+
+// Round-trip all cases as one batch. Returns the cases that failed.
+static int checkBatch(const struct SoftDeflateParams *params) {
+  std::vector<struct SoftDeflatePage> pages(cases.size());
+  std::vector<std::vector<uint8_t>> out(cases.size());
+  for(size_t i = 0; i < cases.size(); i++) {
+    pages[i].data = cases[i].page.data();
+    pages[i].len = cases[i].page.size();
+    pages[i].cap = pages[i].len;
+    bq_init(&pages[i].compressed);
+  }
+  sd_compressBatch(params, pages.data(), pages.size(), BATCH_THREADS);
+  for(size_t i = 0; i < cases.size(); i++) {
+    // one spare character, so that a longer output shows
+    out[i].resize(cases[i].page.size() + 1);
+    pages[i].data = out[i].data();
+    pages[i].cap = out[i].size();
+  }
+  sd_decompressBatch(params, pages.data(), pages.size(), BATCH_THREADS);
+  int failed = 0;
+  for(size_t i = 0; i < cases.size(); i++) {
+    const std::vector<uint8_t> &page = cases[i].page;
+    if(pages[i].err || pages[i].len != page.size() ||
+        memcmp(out[i].data(), page.data(), page.size())) {
+      fprintf(stderr, "%s: batch round trip failed: %s\n", cases[i].name,
+        sd_strerror(pages[i].err));
+      failed++;
+    }
+    bq_free(&pages[i].compressed);
+  }
+  return failed;
+}
+
+int main(int argc, const char **argv) {
+  std::vector<const char*> configs;
+  for(int i = 1; i < argc; i++) {
+    if(!strcmp(argv[i], "--config")) {
+      ++i;
+      assert(i < argc);
+      configs.push_back(argv[i]);
+    }
+    else {
+      fprintf(stderr, "error: unknown option %s\n", argv[i]);
+      return 127;
+    }
+  }
+  if(configs.empty())
+    configs.push_back("configFiles/deflate.csv");
+  
+  int failed = 0;
+  for(const char *spec : configs) {
+    struct Config config;
+    if(!loadConfig(&config, spec))
+      return 127;
+    makeCases(&config.params);
+    printf("config: %s\n", spec);
+    
+    struct SoftDeflateScratch scratch;
+    sd_initScratch(&scratch);
+    int configFailed = 0;
+    for(const Case &c : cases) {
+      size_t bits;
+      bool pass = checkCase(&config.params, &scratch, &c, &bits);
+      printf("  %-40s %8lu bytes %8lu bits %s\n", c.name, c.page.size(), bits,
+        pass ? "pass" : "FAIL");
+      configFailed += !pass;
+    }
+    sd_freeScratch(&scratch);
+    configFailed += checkBatch(&config.params);
+    printf("failed (cases): %d of %lu\n", configFailed, cases.size());
+    failed += configFailed;
+  }
+  return failed < 127 ? failed : 127;
+}
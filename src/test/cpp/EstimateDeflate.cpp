@@ -0,0 +1,241 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <atomic>
+#include <thread>
+#include "PageScan.h"
+#include "SoftDeflate.h"
+#include "SoftDeflateConfig.h"
+
+// Predicts the compressed size of memory dumps for one or more Deflate
+// configurations without generating or simulating any hardware.
+
+// default page size (see `--page-size`)
+#define PAGE_SIZE 4096
+// pages a thread claims from the work counter at a time
+#define CLAIM_PAGES 64
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+
+struct Summary {
+  size_t totalSize;
+  size_t totalPages;
+  size_t nonzeroSize;
+  size_t nonzeroPages;
+  size_t compressedSize;
+};
+
+struct {
+  const char *report;
+  const char *pages;
+  size_t pageSize;
+  int threads;
+} options;
+
+static struct Config *configs;
+static int configCount;
+static struct Dump *dumps;
+static int dumpCount;
+static size_t totalPages;
+// one Summary per configuration per thread
+static struct Summary *summaries;
+// predicted bits of every page of every configuration, for --pages
+static size_t *pageBits;
+static std::atomic<size_t> nextPage;
+
+
+static struct Dump *findDump(size_t page) {
+  int lo = 0, hi = dumpCount - 1;
+  while(lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+    if(dumps[mid].firstPage <= page)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return &dumps[lo];
+}
+
+static void runThread(int id) {
+  size_t end = totalPages * configCount;
+  struct SoftDeflateScratch scratch;
+  sd_initScratch(&scratch);
+  for(;;) {
+    size_t first = nextPage.fetch_add(CLAIM_PAGES);
+    if(first >= end) break;
+    for(size_t i = first; i < min(first + CLAIM_PAGES, end); i++) {
+      int c = i / totalPages;
+      size_t page = i % totalPages;
+      struct Summary *summary = &summaries[id * configCount + c];
+      struct Dump *dump = findDump(page);
+      size_t offset = (page - dump->firstPage) * options.pageSize;
+      size_t len = min(options.pageSize, dump->size - offset);
+      const uint8_t *data = dump->map + offset;
+      
+      summary->totalSize += len;
+      summary->totalPages++;
+      if(isZeroPage(data, len))
+        continue;
+      summary->nonzeroSize += len;
+      summary->nonzeroPages++;
+      
+      size_t bits;
+      int err = sd_estimate(&configs[c].params, &scratch, data, len, &bits);
+      if(err) {
+        fprintf(stderr, "error: %s: %s\n", dump->path, sd_strerror(err));
+        exit(127);
+      }
+      summary->compressedSize += bits;
+      if(pageBits)
+        pageBits[i] = bits;
+    }
+  }
+  sd_freeScratch(&scratch);
+}
+
+int main(int argc, const char **argv) {
+  options.report = "-";
+  options.pages = NULL;
+  options.pageSize = PAGE_SIZE;
+  options.threads = std::thread::hardware_concurrency();
+  configs = (struct Config*)malloc(sizeof(struct Config) * argc);
+  dumps = (struct Dump*)malloc(sizeof(struct Dump) * argc);
+  configCount = 0;
+  dumpCount = 0;
+  const char **configSpecs = (const char**)malloc(sizeof(char*) * argc);
+  for(int i = 1; i < argc; i++) {
+    if(!strcmp(argv[i], "--config")) {
+      ++i;
+      assert(i < argc);
+      configSpecs[configCount++] = argv[i];
+    }
+    else if(!strcmp(argv[i], "--dump")) {
+      ++i;
+      assert(i < argc);
+      if(!openDump(&dumps[dumpCount++], argv[i]))
+        return 127;
+    }
+    else if(!strcmp(argv[i], "--report")) {
+      ++i;
+      assert(i < argc);
+      options.report = argv[i];
+    }
+    else if(!strcmp(argv[i], "--pages")) {
+      ++i;
+      assert(i < argc);
+      options.pages = argv[i];
+    }
+    else if(!strcmp(argv[i], "--page-size")) {
+      ++i;
+      assert(i < argc);
+      options.pageSize = atol(argv[i]);
+      assert(options.pageSize > 0);
+    }
+    else if(!strcmp(argv[i], "--threads")) {
+      ++i;
+      assert(i < argc);
+      options.threads = atoi(argv[i]);
+      if(options.threads <= 0)
+        options.threads = std::thread::hardware_concurrency();
+      assert(options.threads > 0);
+    }
+    else {
+      fprintf(stderr, "error: unknown option %s\n", argv[i]);
+      return 127;
+    }
+  }
+  if(!configCount)
+    configSpecs[configCount++] = "configFiles/deflate.csv";
+  for(int i = 0; i < configCount; i++)
+    if(!loadConfig(&configs[i], configSpecs[i]))
+      return 127;
+  for(int i = 0; i < configCount; i++)
+    checkPageSize(&configs[i], options.pageSize);
+  if(!dumpCount) {
+    fprintf(stderr, "error: no --dump given\n");
+    return 127;
+  }
+  
+  totalPages = 0;
+  for(int i = 0; i < dumpCount; i++) {
+    dumps[i].firstPage = totalPages;
+    totalPages += (dumps[i].size + options.pageSize - 1) / options.pageSize;
+  }
+  summaries = (struct Summary*)calloc(options.threads * configCount,
+    sizeof(struct Summary));
+  pageBits = NULL;
+  if(options.pages)
+    pageBits = (size_t*)malloc(sizeof(size_t) * totalPages * configCount);
+  
+  nextPage = 0;
+  std::thread *threads = new std::thread[options.threads];
+  for(int i = 0; i < options.threads; i++)
+    threads[i] = std::thread(runThread, i);
+  for(int i = 0; i < options.threads; i++)
+    threads[i].join();
+  delete[] threads;
+  
+  FILE *reportfile = stdout;
+  if(strcmp(options.report, "-"))
+    reportfile = fopen(options.report, "w");
+  for(int c = 0; c < configCount; c++) {
+    struct Summary summary;
+    memset(&summary, 0, sizeof(summary));
+    for(int t = 0; t < options.threads; t++) {
+      struct Summary *s = &summaries[t * configCount + c];
+      summary.totalSize += s->totalSize;
+      summary.totalPages += s->totalPages;
+      summary.nonzeroSize += s->nonzeroSize;
+      summary.nonzeroPages += s->nonzeroPages;
+      summary.compressedSize += s->compressedSize;
+    }
+    
+    fprintf(reportfile, "\n***** SUMMARY *****\n");
+    fprintf(reportfile, "config: %s\n", configs[c].spec);
+    fprintf(reportfile, "dumps:");
+    for(int i = 0; i < dumpCount; i++)
+      fprintf(reportfile, " %s", dumps[i].path);
+    fprintf(reportfile, "\n");
+    fprintf(reportfile, "page size (bytes): %lu\n", options.pageSize);
+    fprintf(reportfile, "total (bytes): %lu\n", summary.totalSize);
+    fprintf(reportfile, "total (pages): %lu\n", summary.totalPages);
+    fprintf(reportfile, "non-zero (bytes): %lu\n", summary.nonzeroSize);
+    fprintf(reportfile, "non-zero (pages): %lu\n", summary.nonzeroPages);
+    fprintf(reportfile, "compressed (bits): %lu\n", summary.compressedSize);
+    fprintf(reportfile, "compression ratio: %f\n", (double)summary.nonzeroSize / summary.compressedSize * 8);
+  }
+  if(reportfile != stdout)
+    fclose(reportfile);
+  
+  if(options.pages) {
+    // one line per non-zero page; `config` indexes the --config options
+    FILE *pagesfile = fopen(options.pages, "w");
+    fprintf(pagesfile, "config,dump,page,bits\n");
+    for(int c = 0; c < configCount; c++) {
+      for(size_t page = 0; page < totalPages; page++) {
+        struct Dump *dump = findDump(page);
+        size_t offset = (page - dump->firstPage) * options.pageSize;
+        if(isZeroPage(dump->map + offset,
+            min(options.pageSize, dump->size - offset)))
+          continue;
+        fprintf(pagesfile, "%d,%s,%lu,%lu\n", c, dump->path,
+          page - dump->firstPage, pageBits[c * totalPages + page]);
+      }
+    }
+    fclose(pagesfile);
+  }
+  
+  for(int i = 0; i < dumpCount; i++)
+    closeDump(&dumps[i]);
+  free(summaries);
+  free(pageBits);
+  free(configSpecs);
+  free(configs);
+  free(dumps);
+  return 0;
+}
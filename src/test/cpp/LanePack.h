@@ -0,0 +1,181 @@
+#ifndef LANE_PACK_H
+#define LANE_PACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include "BitQueue.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LANE_PACK_X86 1
+#else
+#define LANE_PACK_X86 0
+#endif
+
+// Conversion between the single-bit lanes of a Verilated stream interface
+// (`io_*_data_0`, `io_*_data_1`, ... laid out as consecutive bytes holding 0 or
+// 1) and bits in a BitQueue, lane 0 being the first bit.
+
+// Gather eight 0/1 bytes into eight bits. The multiplier places byte `i` at
+// bit 56 + i, and no two partial products overlap, so nothing carries.
+static inline uint64_t packLanes8(const uint8_t *lanes) {
+  uint64_t w;
+  memcpy(&w, lanes, 8);
+  return (w * 0x0102040810204080ull) >> 56;
+}
+
+// Spread eight bits into eight 0/1 bytes. Byte `i` first receives bit `i`
+// in place, which is then moved down to bit 0 without crossing bytes.
+static inline uint64_t unpackLanes8(uint64_t bits) {
+  uint64_t w = (bits & 0xff) * 0x0101010101010101ull & 0x8040201008040201ull;
+  return (w + 0x7f7f7f7f7f7f7f7full) >> 7 & 0x0101010101010101ull;
+}
+
+static inline uint64_t packLanesScalar(const uint8_t *lanes, int n) {
+  uint64_t bits = 0;
+  int i = 0;
+  for(; i + 8 <= n; i += 8)
+    bits |= packLanes8(lanes + i) << i;
+  for(; i < n; i++)
+    bits |= (uint64_t)(lanes[i] != 0) << i;
+  return bits;
+}
+
+static inline void unpackLanesScalar(uint64_t bits, uint8_t *lanes, int n) {
+  int i = 0;
+  for(; i + 8 <= n; i += 8) {
+    uint64_t w = unpackLanes8(bits >> i);
+    memcpy(lanes + i, &w, 8);
+  }
+  for(; i < n; i++)
+    lanes[i] = bits >> i & 1;
+}
+
+#if LANE_PACK_X86
+__attribute__((target("sse2")))
+static inline uint64_t packLanesSSE2(const uint8_t *lanes, int n) {
+  uint64_t bits = 0;
+  int i = 0;
+  for(; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(lanes + i));
+    uint32_t zero = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+    bits |= (uint64_t)(~zero & 0xffff) << i;
+  }
+  if(i < n)
+    bits |= packLanesScalar(lanes + i, n - i) << i;
+  return bits;
+}
+
+__attribute__((target("sse2")))
+static inline void unpackLanesSSE2(uint64_t bits, uint8_t *lanes, int n) {
+  const __m128i select = _mm_set1_epi64x(0x8040201008040201ll);
+  int i = 0;
+  for(; i + 16 <= n; i += 16) {
+    // replicate byte 0 into lanes 0-7 and byte 1 into lanes 8-15
+    __m128i v = _mm_set1_epi16((uint16_t)(bits >> i));
+    v = _mm_unpacklo_epi8(v, v);
+    v = _mm_unpacklo_epi16(v, v);
+    v = _mm_unpacklo_epi32(v, v);
+    v = _mm_cmpeq_epi8(_mm_and_si128(v, select), select);
+    v = _mm_and_si128(v, _mm_set1_epi8(1));
+    _mm_storeu_si128((__m128i*)(lanes + i), v);
+  }
+  if(i < n)
+    unpackLanesScalar(bits >> i, lanes + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t packLanesAVX2(const uint8_t *lanes, int n) {
+  uint64_t bits = 0;
+  int i = 0;
+  for(; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(lanes + i));
+    uint32_t zero = _mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+    bits |= (uint64_t)~zero << i;
+  }
+  if(i < n)
+    bits |= packLanesSSE2(lanes + i, n - i) << i;
+  return bits;
+}
+
+__attribute__((target("avx2")))
+static inline void unpackLanesAVX2(uint64_t bits, uint8_t *lanes, int n) {
+  const __m256i select = _mm256_set1_epi64x(0x8040201008040201ll);
+  // byte `i / 8` of the broadcast word goes to lane `i`
+  const __m256i spread = _mm256_setr_epi8(
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+  int i = 0;
+  for(; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_set1_epi32((uint32_t)(bits >> i));
+    v = _mm256_shuffle_epi8(v, spread);
+    v = _mm256_cmpeq_epi8(_mm256_and_si256(v, select), select);
+    v = _mm256_and_si256(v, _mm256_set1_epi8(1));
+    _mm256_storeu_si256((__m256i*)(lanes + i), v);
+  }
+  if(i < n)
+    unpackLanesSSE2(bits >> i, lanes + i, n - i);
+}
+#endif
+
+typedef uint64_t (*PackLanesFn)(const uint8_t *lanes, int n);
+typedef void (*UnpackLanesFn)(uint64_t bits, uint8_t *lanes, int n);
+
+static inline bool laneCpuHasAVX2() {
+#if LANE_PACK_X86
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+// Pack `n` (<= 64) lanes into the low bits of a word
+static inline uint64_t packLanes(const uint8_t *lanes, int n) {
+#if LANE_PACK_X86
+  static const PackLanesFn pack =
+    laneCpuHasAVX2() ? packLanesAVX2 : packLanesSSE2;
+#else
+  static const PackLanesFn pack = packLanesScalar;
+#endif
+  return pack(lanes, n);
+}
+
+// Unpack the low `n` (<= 64) bits of a word into lanes. Exactly `n` bytes
+// are written, so the fields after the last lane are left alone.
+static inline void unpackLanes(uint64_t bits, uint8_t *lanes, int n) {
+#if LANE_PACK_X86
+  static const UnpackLanesFn unpack =
+    laneCpuHasAVX2() ? unpackLanesAVX2 : unpackLanesSSE2;
+#else
+  static const UnpackLanesFn unpack = unpackLanesScalar;
+#endif
+  unpack(bits, lanes, n);
+}
+
+// Push `n` lanes onto the tail of a queue
+static inline void lanesToQueue(struct BitQueue *queue,
+    const uint8_t *lanes, int n) {
+  for(int i = 0; i < n; i += 64) {
+    int k = n - i < 64 ? n - i : 64;
+    char err = bq_pushBits(queue, packLanes(lanes + i, k), k);
+    assert(!err);
+  }
+}
+
+// Expose `n` bits of a queue starting `offset` bits after the head on lanes
+static inline void queueToLanes(const struct BitQueue *queue, size_t offset,
+    uint8_t *lanes, int n) {
+  for(int i = 0; i < n; i += 64) {
+    int k = n - i < 64 ? n - i : 64;
+    uint64_t bits;
+    char err = bq_peekBits(queue, offset + i, &bits, k);
+    assert(!err);
+    unpackLanes(bits, lanes + i, k);
+  }
+}
+
+#endif
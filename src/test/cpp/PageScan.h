@@ -0,0 +1,246 @@
+#ifndef PAGE_SCAN_H
+#define PAGE_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PAGE_SCAN_X86 1
+#else
+#define PAGE_SCAN_X86 0
+#endif
+
+// Check whether a buffer holds only zero bytes. Most pages of a memory dump
+// are zero, so the loader calls this for every page. The widest scan the CPU
+// supports is picked at run time so the binary stays portable.
+
+static inline bool isZeroTail(const uint8_t *buf, size_t len) {
+  uint8_t acc = 0;
+  for(size_t i = 0; i < len; i++)
+    acc |= buf[i];
+  return acc == 0;
+}
+
+static inline bool isZero64(const uint8_t *buf, size_t len) {
+  size_t i = 0;
+  for(; i + 32 <= len; i += 32) {
+    uint64_t w0, w1, w2, w3;
+    memcpy(&w0, buf + i, 8);
+    memcpy(&w1, buf + i + 8, 8);
+    memcpy(&w2, buf + i + 16, 8);
+    memcpy(&w3, buf + i + 24, 8);
+    if(w0 | w1 | w2 | w3)
+      return false;
+  }
+  for(; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, buf + i, 8);
+    if(w)
+      return false;
+  }
+  return isZeroTail(buf + i, len - i);
+}
+
+#if PAGE_SCAN_X86
+__attribute__((target("sse2")))
+static inline bool isZeroSSE2(const uint8_t *buf, size_t len) {
+  size_t i = 0;
+  for(; i + 64 <= len; i += 64) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(buf + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(buf + i + 16));
+    __m128i c = _mm_loadu_si128((const __m128i*)(buf + i + 32));
+    __m128i d = _mm_loadu_si128((const __m128i*)(buf + i + 48));
+    __m128i acc = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+    if(_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xffff)
+      return false;
+  }
+  return isZero64(buf + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static inline bool isZeroAVX2(const uint8_t *buf, size_t len) {
+  size_t i = 0;
+  for(; i + 128 <= len; i += 128) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(buf + i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(buf + i + 32));
+    __m256i c = _mm256_loadu_si256((const __m256i*)(buf + i + 64));
+    __m256i d = _mm256_loadu_si256((const __m256i*)(buf + i + 96));
+    __m256i acc = _mm256_or_si256(_mm256_or_si256(a, b),
+      _mm256_or_si256(c, d));
+    if(!_mm256_testz_si256(acc, acc))
+      return false;
+  }
+  return isZero64(buf + i, len - i);
+}
+#endif
+
+typedef bool (*ZeroScanFn)(const uint8_t *buf, size_t len);
+
+static inline ZeroScanFn pickZeroScan() {
+#if PAGE_SCAN_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2"))
+    return isZeroAVX2;
+  if(__builtin_cpu_supports("sse2"))
+    return isZeroSSE2;
+#endif
+  return isZero64;
+}
+
+static inline bool isZeroPage(const uint8_t *buf, size_t len) {
+  static const ZeroScanFn scan = pickZeroScan();
+  return scan(buf, len);
+}
+
+// Check whether a page repeats its first 8-byte word throughout, as pages
+// filled with 0xff, poisoned free memory or a repeated pointer do. A tail
+// shorter than a word must match the start of the word. Zero pages pass too,
+// so the loader checks for them first. Scanned like isZeroPage, and the scan
+// stops at the first block that differs, so other pages cost little.
+
+static inline bool isSameWordTail(const uint8_t *buf, size_t len, size_t i,
+    uint64_t word) {
+  uint64_t acc = 0;
+  for(; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, buf + i, 8);
+    acc |= w ^ word;
+  }
+  return acc == 0 && !memcmp(buf + i, buf, len - i);
+}
+
+static inline bool isSameWord64(const uint8_t *buf, size_t len,
+    uint64_t word) {
+  size_t i = 0;
+  for(; i + 32 <= len; i += 32) {
+    uint64_t w0, w1, w2, w3;
+    memcpy(&w0, buf + i, 8);
+    memcpy(&w1, buf + i + 8, 8);
+    memcpy(&w2, buf + i + 16, 8);
+    memcpy(&w3, buf + i + 24, 8);
+    if((w0 ^ word) | (w1 ^ word) | (w2 ^ word) | (w3 ^ word))
+      return false;
+  }
+  return isSameWordTail(buf, len, i, word);
+}
+
+#if PAGE_SCAN_X86
+__attribute__((target("sse2")))
+static inline bool isSameWordSSE2(const uint8_t *buf, size_t len,
+    uint64_t word) {
+  __m128i p = _mm_set1_epi64x(word);
+  size_t i = 0;
+  for(; i + 64 <= len; i += 64) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(buf + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(buf + i + 16));
+    __m128i c = _mm_loadu_si128((const __m128i*)(buf + i + 32));
+    __m128i d = _mm_loadu_si128((const __m128i*)(buf + i + 48));
+    __m128i acc = _mm_or_si128(
+      _mm_or_si128(_mm_xor_si128(a, p), _mm_xor_si128(b, p)),
+      _mm_or_si128(_mm_xor_si128(c, p), _mm_xor_si128(d, p)));
+    if(_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xffff)
+      return false;
+  }
+  return isSameWordTail(buf, len, i, word);
+}
+
+__attribute__((target("avx2")))
+static inline bool isSameWordAVX2(const uint8_t *buf, size_t len,
+    uint64_t word) {
+  __m256i p = _mm256_set1_epi64x(word);
+  size_t i = 0;
+  for(; i + 128 <= len; i += 128) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(buf + i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(buf + i + 32));
+    __m256i c = _mm256_loadu_si256((const __m256i*)(buf + i + 64));
+    __m256i d = _mm256_loadu_si256((const __m256i*)(buf + i + 96));
+    __m256i acc = _mm256_or_si256(
+      _mm256_or_si256(_mm256_xor_si256(a, p), _mm256_xor_si256(b, p)),
+      _mm256_or_si256(_mm256_xor_si256(c, p), _mm256_xor_si256(d, p)));
+    if(!_mm256_testz_si256(acc, acc))
+      return false;
+  }
+  return isSameWordTail(buf, len, i, word);
+}
+#endif
+
+typedef bool (*SameWordScanFn)(const uint8_t *buf, size_t len, uint64_t word);
+
+static inline SameWordScanFn pickSameWordScan() {
+#if PAGE_SCAN_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2"))
+    return isSameWordAVX2;
+  if(__builtin_cpu_supports("sse2"))
+    return isSameWordSSE2;
+#endif
+  return isSameWord64;
+}
+
+// pages shorter than a word do not count
+static inline bool isSameWordPage(const uint8_t *buf, size_t len) {
+  static const SameWordScanFn scan = pickSameWordScan();
+  if(len < 8)
+    return false;
+  uint64_t word;
+  memcpy(&word, buf, 8);
+  return scan(buf, len, word);
+}
+
+// 128-bit hash of a page's contents, to find candidate identical pages. It is
+// not cryptographic, so a hash match is confirmed by comparing the bytes of
+// the pages (see `--dedup`).
+struct PageHash {
+  uint64_t lo;
+  uint64_t hi;
+};
+
+static inline uint64_t mixHash(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static inline struct PageHash hashPage(const uint8_t *buf, size_t len) {
+  // two differently mixed lanes over the same 8-byte words
+  uint64_t a = 0x9e3779b97f4a7c15ULL ^ len;
+  uint64_t b = 0xc2b2ae3d27d4eb4fULL + len;
+  size_t i = 0;
+  for(; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, buf + i, 8);
+    a = (a ^ w) * 0x87c37b91114253d5ULL;
+    a = (a << 31) | (a >> 33);
+    b = (b + w) * 0x4cf5ad432745937fULL;
+    b ^= b >> 29;
+  }
+  uint64_t w = 0;
+  memcpy(&w, buf + i, len - i);
+  struct PageHash h = {mixHash(a ^ w), mixHash(b + w)};
+  return h;
+}
+
+// Entropy of the byte values of a page, in bits per byte (0 to 8). It is a
+// cheap hint of how well the page compresses, used to stratify sampled pages.
+static inline double pageEntropy(const uint8_t *buf, size_t len) {
+  uint32_t counts[256] = {0};
+  for(size_t i = 0; i < len; i++)
+    counts[buf[i]]++;
+  double entropy = 0;
+  for(int c = 0; c < 256; c++) {
+    if(!counts[c])
+      continue;
+    double p = (double)counts[c] / len;
+    entropy -= p * log2(p);
+  }
+  return entropy;
+}
+
+#endif
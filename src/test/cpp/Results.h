@@ -0,0 +1,331 @@
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Machine-readable test results (`--results`), read back by the reporter
+// (buildSrc/src/main/scala/SummarizeEachTest.scala). All integers are little
+// endian. A file is laid out as:
+//
+//   header   "DFRESULT", u32 version, u32 page size, u32 dump name length,
+//            dump name, u32 compressor stage count s, then for each stage
+//            u32 name length and name
+//   blocks   u32 page count n (0 ends the blocks), then one column after the
+//            other, each n values: i64 id, u8 pass, u8 duplicate
+//            (RESULT_PAGE_*), u8 aborted, u8 same value, u32 raw size,
+//            u32 compressed bits, u32 compressor cycles, u32 decompressor
+//            cycles, u32 compressor cycles of each kind
+//            (RESULT_CYCLE_KINDS columns), then the same for the decompressor,
+//            then the occupancy of each compressor stage (RESULT_CYCLE_KINDS
+//            columns per stage)
+//   summary  u32 counter count, u64 counters (RESULT_* order, then
+//            RESULT_CYCLE_KINDS per compressor stage), u32 histogram count,
+//            u32 buckets per histogram, then for each histogram
+//            (RESULT_HIST_* order) u64 maximum and u64 buckets, then u32
+//            stratum count (0 without `--sample`), u32 measures per stratum,
+//            and for each stratum u64 pages, u64 sampled pages, then u64 sum
+//            and u64 sum of squares of each measure (RESULT_SAMPLE_* order)
+//            over the sampled pages
+//   footer   u64 offset of the summary, "DFRESULT"
+//
+// Counters, histogram buckets and stratum sums of several files add up and
+// maxima combine by maximum, so shards merge without looking at their pages.
+// The sampling estimates only need the stratum sums, so they are computed
+// after merging.
+
+#define RESULT_VERSION 10
+#define RESULT_MAGIC "DFRESULT"
+// pages buffered before a block is written
+#define RESULT_BLOCK_PAGES 1024
+
+// What held a module back in a simulated cycle
+#define CYCLE_BUSY 0
+#define CYCLE_STARVED 1
+#define CYCLE_BACKPRESSURED 2
+#define CYCLE_IDLE 3
+#define RESULT_CYCLE_KINDS 4
+
+// summary counters
+#define RESULT_TOTAL_SIZE 0
+#define RESULT_TOTAL_PAGES 1
+#define RESULT_NONZERO_SIZE 2
+#define RESULT_NONZERO_PAGES 3
+#define RESULT_COMPRESSED_SIZE 4
+#define RESULT_PASSED_PAGES 5
+#define RESULT_FAILED_PAGES 6
+#define RESULT_COMPRESSOR_CYCLES 7
+#define RESULT_DECOMPRESSOR_CYCLES 8
+// RESULT_CYCLE_KINDS counters each
+#define RESULT_COMPRESSOR_KINDS 9
+#define RESULT_DECOMPRESSOR_KINDS (RESULT_COMPRESSOR_KINDS + RESULT_CYCLE_KINDS)
+// host time spent simulating each module, in nanoseconds
+#define RESULT_COMPRESSOR_HOST_NS \
+  (RESULT_DECOMPRESSOR_KINDS + RESULT_CYCLE_KINDS)
+#define RESULT_DECOMPRESSOR_HOST_NS (RESULT_COMPRESSOR_HOST_NS + 1)
+// pages identical to an earlier one, and those whose results were reused
+#define RESULT_DUPLICATE_PAGES (RESULT_DECOMPRESSOR_HOST_NS + 1)
+#define RESULT_REUSED_PAGES (RESULT_DUPLICATE_PAGES + 1)
+// pages the compressor gave up on (see `--abort-threshold`), and an estimate
+// (not a measurement) of the compressor cycles that saved
+#define RESULT_ABORTED_PAGES (RESULT_REUSED_PAGES + 1)
+#define RESULT_ABORTED_SIZE (RESULT_ABORTED_PAGES + 1)
+#define RESULT_ABORTED_BITS (RESULT_ABORTED_SIZE + 1)
+#define RESULT_ESTIMATED_SAVED_CYCLES (RESULT_ABORTED_BITS + 1)
+// pages repeating one 8-byte word (see `--same-pages`)
+#define RESULT_SAME_PAGES (RESULT_ESTIMATED_SAVED_CYCLES + 1)
+#define RESULT_SAME_SIZE (RESULT_SAME_PAGES + 1)
+#define RESULT_SAME_BITS (RESULT_SAME_SIZE + 1)
+#define RESULT_SAME_COMPRESSOR_CYCLES (RESULT_SAME_BITS + 1)
+#define RESULT_SAME_DECOMPRESSOR_CYCLES (RESULT_SAME_COMPRESSOR_CYCLES + 1)
+// non-zero pages left out by `--sample`, which the counts above do not
+// include
+#define RESULT_UNSAMPLED_PAGES (RESULT_SAME_DECOMPRESSOR_CYCLES + 1)
+#define RESULT_UNSAMPLED_SIZE (RESULT_UNSAMPLED_PAGES + 1)
+#define RESULT_COUNTERS (RESULT_UNSAMPLED_SIZE + 1)
+// The occupancy of the compressor's pipeline stages follows, in cycles of
+// each kind per stage. The stages differ by stream, so their names are in
+// the header.
+#define RESULT_MAX_STAGES 8
+#define RESULT_STAGE_KINDS(s) (RESULT_COUNTERS + (s) * RESULT_CYCLE_KINDS)
+#define RESULT_MAX_COUNTERS RESULT_STAGE_KINDS(RESULT_MAX_STAGES)
+
+// summary histograms
+#define RESULT_HIST_COMPRESSOR_LATENCY 0
+#define RESULT_HIST_DECOMPRESSOR_LATENCY 1
+#define RESULT_HISTOGRAMS 2
+
+// what each sampled page of `--sample` contributes to the estimates
+#define RESULT_SAMPLE_BITS 0
+#define RESULT_SAMPLE_C_CYCLES 1
+#define RESULT_SAMPLE_D_CYCLES 2
+#define RESULT_SAMPLE_MEASURES 3
+
+// The non-zero pages of one stratum of `--sample`, and the sums of each
+// measure and of its square over the sampled ones. The measures are whole
+// numbers, so the sums are exact while they stay below 2^53.
+struct ResultStratum {
+  uint64_t pages;
+  uint64_t sampled;
+  double sum[RESULT_SAMPLE_MEASURES];
+  double sumSq[RESULT_SAMPLE_MEASURES];
+};
+
+// Log-linear histogram buckets: values below 64 have a bucket each, and every
+// power of two above is split into 32 buckets, so a bucket is at most 1/32
+// of its values wide.
+#define RESULT_HIST_SUB_BITS 5
+#define RESULT_HIST_BUCKETS (64 + (64 - 6) * 32)
+
+struct ResultHistogram {
+  uint64_t buckets[RESULT_HIST_BUCKETS];
+  uint64_t count;
+  uint64_t max;
+};
+
+static inline int rh_bucket(uint64_t v) {
+  if(v < 64)
+    return v;
+  int e = 63 - __builtin_clzll(v);
+  return 64 + (e - 6) * 32 +
+    (int)((v >> (e - RESULT_HIST_SUB_BITS)) & 31);
+}
+
+// largest value that falls in a bucket
+static inline uint64_t rh_bucketHigh(int b) {
+  if(b < 64)
+    return b;
+  int e = (b - 64) / 32 + 6;
+  uint64_t low = (uint64_t)(32 + (b - 64) % 32) << (e - RESULT_HIST_SUB_BITS);
+  return low + ((uint64_t)1 << (e - RESULT_HIST_SUB_BITS)) - 1;
+}
+
+static inline void rh_add(struct ResultHistogram *hist, uint64_t v) {
+  hist->buckets[rh_bucket(v)]++;
+  hist->count++;
+  if(v > hist->max)
+    hist->max = v;
+}
+
+static inline void rh_merge(struct ResultHistogram *sum,
+    const struct ResultHistogram *part) {
+  for(int b = 0; b < RESULT_HIST_BUCKETS; b++)
+    sum->buckets[b] += part->buckets[b];
+  sum->count += part->count;
+  if(part->max > sum->max)
+    sum->max = part->max;
+}
+
+// Nearest-rank percentile, exact below 64 and otherwise the top of its
+// bucket (never above the maximum)
+static inline uint64_t rh_percentile(const struct ResultHistogram *hist,
+    int p) {
+  uint64_t rank = (hist->count * p + 99) / 100;
+  if(rank == 0)
+    return 0;
+  uint64_t seen = 0;
+  for(int b = 0; b < RESULT_HIST_BUCKETS; b++) {
+    seen += hist->buckets[b];
+    if(seen >= rank)
+      return rh_bucketHigh(b) < hist->max ? rh_bucketHigh(b) : hist->max;
+  }
+  return hist->max;
+}
+
+
+// whether a page repeats an earlier one of the dump (see `--dedup`)
+#define RESULT_PAGE_UNIQUE 0
+#define RESULT_PAGE_DUPLICATE 1
+// a duplicate whose results were taken from the earlier page
+#define RESULT_PAGE_REUSED 2
+
+struct ResultPage {
+  int64_t id;
+  bool pass;
+  uint8_t duplicate;
+  // the compressor gave up on the page (see `--abort-threshold`)
+  bool aborted;
+  // the page repeats one 8-byte word (see `--same-pages`)
+  bool sameValue;
+  uint32_t rawSize;
+  uint32_t compressedBits;
+  uint32_t compressorCycles;
+  uint32_t decompressorCycles;
+  uint32_t compressorKinds[RESULT_CYCLE_KINDS];
+  uint32_t decompressorKinds[RESULT_CYCLE_KINDS];
+  uint32_t stageKinds[RESULT_MAX_STAGES][RESULT_CYCLE_KINDS];
+};
+
+struct ResultWriter {
+  FILE *file;
+  struct ResultPage pages[RESULT_BLOCK_PAGES];
+  int count;
+  // compressor stages of each page
+  int stages;
+};
+
+static inline void rw_put(struct ResultWriter *w, uint64_t v, int bytes) {
+  uint8_t buf[8];
+  for(int i = 0; i < bytes; i++)
+    buf[i] = v >> (8 * i);
+  fwrite(buf, 1, bytes, w->file);
+}
+
+// `stages` (at most RESULT_MAX_STAGES) names the compressor's stages. False
+// if the file cannot be created.
+static inline bool rw_open(struct ResultWriter *w, const char *path,
+    uint32_t pageSize, const char *dump, int stages,
+    const char *const *stageNames) {
+  w->file = fopen(path, "wb");
+  if(w->file == NULL)
+    return false;
+  w->count = 0;
+  w->stages = stages;
+  fwrite(RESULT_MAGIC, 1, 8, w->file);
+  rw_put(w, RESULT_VERSION, 4);
+  rw_put(w, pageSize, 4);
+  rw_put(w, strlen(dump), 4);
+  fwrite(dump, 1, strlen(dump), w->file);
+  rw_put(w, stages, 4);
+  for(int s = 0; s < stages; s++) {
+    rw_put(w, strlen(stageNames[s]), 4);
+    fwrite(stageNames[s], 1, strlen(stageNames[s]), w->file);
+  }
+  return true;
+}
+
+static inline void rw_flush(struct ResultWriter *w) {
+  if(!w->count)
+    return;
+  int n = w->count;
+  struct ResultPage *p = w->pages;
+  rw_put(w, n, 4);
+  for(int i = 0; i < n; i++) rw_put(w, p[i].id, 8);
+  for(int i = 0; i < n; i++) rw_put(w, p[i].pass, 1);
+  for(int i = 0; i < n; i++) rw_put(w, p[i].duplicate, 1);
+  for(int i = 0; i < n; i++) rw_put(w, p[i].aborted, 1);
+  for(int i = 0; i < n; i++) rw_put(w, p[i].sameValue, 1);
+  for(int i = 0; i < n; i++) rw_put(w, p[i].rawSize, 4);
+  for(int i = 0; i < n; i++) rw_put(w, p[i].compressedBits, 4);
+  for(int i = 0; i < n; i++) rw_put(w, p[i].compressorCycles, 4);
+  for(int i = 0; i < n; i++) rw_put(w, p[i].decompressorCycles, 4);
+  for(int k = 0; k < RESULT_CYCLE_KINDS; k++)
+    for(int i = 0; i < n; i++) rw_put(w, p[i].compressorKinds[k], 4);
+  for(int k = 0; k < RESULT_CYCLE_KINDS; k++)
+    for(int i = 0; i < n; i++) rw_put(w, p[i].decompressorKinds[k], 4);
+  for(int s = 0; s < w->stages; s++)
+    for(int k = 0; k < RESULT_CYCLE_KINDS; k++)
+      for(int i = 0; i < n; i++) rw_put(w, p[i].stageKinds[s][k], 4);
+  w->count = 0;
+}
+
+static inline void rw_page(struct ResultWriter *w,
+    const struct ResultPage *page) {
+  w->pages[w->count++] = *page;
+  if(w->count == RESULT_BLOCK_PAGES)
+    rw_flush(w);
+}
+
+// Write out the buffered pages and return the end of the blocks so far, from
+// which rw_resume continues the file.
+static inline long rw_sync(struct ResultWriter *w) {
+  rw_flush(w);
+  fflush(w->file);
+  return ftell(w->file);
+}
+
+// Continue a file of an interrupted run after the blocks up to `offset` (see
+// rw_sync), dropping what was written after them. `stages` is as it was
+// opened with. False if the file cannot be opened.
+static inline bool rw_resume(struct ResultWriter *w, const char *path,
+    long offset, int stages) {
+  w->file = fopen(path, "r+b");
+  if(w->file == NULL)
+    return false;
+  w->count = 0;
+  w->stages = stages;
+  return !ftruncate(fileno(w->file), offset) &&
+    !fseek(w->file, offset, SEEK_SET);
+}
+
+// Write the summary and close the file. `counters` holds those of the
+// writer's stages too; `strata` are those of `--sample` (none without it).
+static inline void rw_close(struct ResultWriter *w,
+    const uint64_t counters[RESULT_MAX_COUNTERS],
+    const struct ResultHistogram hists[RESULT_HISTOGRAMS],
+    const struct ResultStratum *strata, int strataCount) {
+  rw_flush(w);
+  rw_put(w, 0, 4);
+  uint64_t offset = ftell(w->file);
+  int count = RESULT_STAGE_KINDS(w->stages);
+  rw_put(w, count, 4);
+  for(int i = 0; i < count; i++)
+    rw_put(w, counters[i], 8);
+  rw_put(w, RESULT_HISTOGRAMS, 4);
+  rw_put(w, RESULT_HIST_BUCKETS, 4);
+  for(int h = 0; h < RESULT_HISTOGRAMS; h++) {
+    rw_put(w, hists[h].max, 8);
+    for(int b = 0; b < RESULT_HIST_BUCKETS; b++)
+      rw_put(w, hists[h].buckets[b], 8);
+  }
+  rw_put(w, strataCount, 4);
+  rw_put(w, RESULT_SAMPLE_MEASURES, 4);
+  for(int h = 0; h < strataCount; h++) {
+    rw_put(w, strata[h].pages, 8);
+    rw_put(w, strata[h].sampled, 8);
+    for(int m = 0; m < RESULT_SAMPLE_MEASURES; m++) {
+      rw_put(w, (uint64_t)strata[h].sum[m], 8);
+      rw_put(w, (uint64_t)strata[h].sumSq[m], 8);
+    }
+  }
+  rw_put(w, offset, 8);
+  fwrite(RESULT_MAGIC, 1, 8, w->file);
+  fclose(w->file);
+  w->file = NULL;
+}
+
+#endif
@@ -0,0 +1,812 @@
+
+#include "SoftDeflate.h"
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+// the decode table is indexed by at least this many bits so that several
+// short codes can be decoded with one lookup
+#define FAST_BITS 10
+// most literals decoded with one lookup
+#define FAST_CHARS 4
+// zero bytes after the end of the input so the decoder can always load a
+// whole word
+#define INPUT_PADDING 8
+
+// bits needed to hold values 0 through `value`
+static int valBits(int value) {
+  int bits = 0;
+  while(((long)1 << bits) <= value)
+    bits++;
+  return bits;
+}
+
+// one entry per possible value of the next tableBits bits
+struct HuffmanEntry {
+  uint8_t length; // of the first code; zero if no code matches
+  bool escape;
+  uint8_t character;
+  // Literals (neither escaped nor the LZ escape character) whose codes all
+  // fit in the index, and where each of their codes ends. No literals if
+  // the first symbol needs the slow path.
+  uint8_t count;
+  uint8_t literals[FAST_CHARS];
+  uint8_t ends[FAST_CHARS];
+};
+
+struct Decoder {
+  const struct SoftDeflateParams *params;
+  // LSB-first stream followed by INPUT_PADDING zero bytes
+  const uint8_t *in;
+  size_t size;
+  size_t pos;
+  struct HuffmanEntry *table;
+  int tableBits;
+};
+
+// at least 56 bits starting at the read position
+static uint64_t peekWord(const struct Decoder *dec) {
+  uint64_t word;
+  memcpy(&word, dec->in + dec->pos / 8, 8);
+  return word >> dec->pos % 8;
+}
+
+static int readBits(struct Decoder *dec, int count, uint64_t *value) {
+  if(dec->pos + count > dec->size)
+    return SD_TRUNCATED;
+  *value = peekWord(dec) & (((uint64_t)1 << count) - 1);
+  dec->pos += count;
+  return SD_OK;
+}
+
+static int readMetadata(struct Decoder *dec) {
+  const struct SoftDeflateParams *params = dec->params;
+  int lengthBits = valBits(params->maxCodeLength);
+  size_t tableSize = (size_t)1 << dec->tableBits;
+  for(size_t i = 0; i < tableSize; i++)
+    dec->table[i].length = 0;
+  
+  // the escape code comes first, then the codes of common characters
+  for(int index = 0;; index++) {
+    uint64_t length, character = 0, code;
+    int err = readBits(dec, lengthBits, &length);
+    if(err) return err;
+    if(length == 0)
+      break;
+    if(index >= params->codeCount || length > (uint64_t)params->maxCodeLength)
+      return SD_BAD_METADATA;
+    
+    if(index != 0) {
+      err = readBits(dec, params->characterBits, &character);
+      if(err) return err;
+    }
+    err = readBits(dec, length, &code);
+    if(err) return err;
+    
+    // fill every entry whose low bits are this code
+    for(size_t i = code; i < tableSize; i += (size_t)1 << length) {
+      dec->table[i].length = length;
+      dec->table[i].escape = index == 0;
+      dec->table[i].character = character;
+    }
+  }
+  
+  // The literals of an index are its first code followed by the literals of
+  // the index of the remaining bits, as far as those bits are known. That
+  // index is smaller, so it is already done. (For index zero it is the same
+  // entry, whose list grows as it is read.)
+  for(size_t i = 0; i < tableSize; i++) {
+    struct HuffmanEntry *entry = &dec->table[i];
+    entry->count = 0;
+    if(!entry->length || entry->escape ||
+        entry->character == params->escapeCharacter)
+      continue;
+    entry->literals[0] = entry->character;
+    entry->ends[0] = entry->length;
+    entry->count = 1;
+    const struct HuffmanEntry *rest = &dec->table[i >> entry->length];
+    for(int k = 0; k < rest->count && entry->count < FAST_CHARS; k++) {
+      int end = entry->length + rest->ends[k];
+      if(end > dec->tableBits) break;
+      entry->literals[entry->count] = rest->literals[k];
+      entry->ends[entry->count++] = end;
+    }
+  }
+  return SD_OK;
+}
+
+// Decode the next character from the Huffman stream. Returns -1 at the end
+// of the stream, SD_OK, or an error.
+static int readCharacter(struct Decoder *dec, int *character) {
+  const struct SoftDeflateParams *params = dec->params;
+  size_t remaining = dec->size - dec->pos;
+  if(remaining == 0)
+    return -1;
+  
+  // past the end of the stream the hardware sees zeros, as does the padding
+  uint64_t bits = peekWord(dec) & (((uint64_t)1 << dec->tableBits) - 1);
+  const struct HuffmanEntry *entry = &dec->table[bits];
+  if(entry->length == 0)
+    return SD_BAD_CODE;
+  if(entry->length > remaining)
+    return SD_TRUNCATED;
+  dec->pos += entry->length;
+  
+  if(entry->escape) {
+    uint64_t value;
+    int err = readBits(dec, params->characterBits, &value);
+    if(err) return err;
+    *character = value;
+  }
+  else {
+    *character = entry->character;
+  }
+  return SD_OK;
+}
+
+// like readCharacter, but the end of the stream is an error
+static int readEncodingCharacter(struct Decoder *dec, int *character) {
+  int err = readCharacter(dec, character);
+  return err < 0 ? SD_TRUNCATED : err;
+}
+
+// Copy an LZ match. Matches at least 16 characters back are copied 16 at a
+// time, which compiles to vector moves; the last chunk may write past the
+// match, so it is only done with room to spare.
+static void copyMatch(uint8_t *out, size_t pos, size_t distance,
+    size_t length, size_t outCap) {
+  uint8_t *dst = out + pos;
+  const uint8_t *src = dst - distance;
+  size_t i = 0;
+  if(distance >= 16 && pos + length + 16 <= outCap) {
+    for(; i < length; i += 16)
+      memcpy(dst + i, src + i, 16);
+  }
+  else if(distance >= 8 && pos + length + 8 <= outCap) {
+    for(; i < length; i += 8)
+      memcpy(dst + i, src + i, 8);
+  }
+  else if(distance == 1) {
+    memset(dst, *src, length);
+  }
+  else {
+    // the source overlaps the characters being written
+    for(; i < length; i++)
+      dst[i] = src[i];
+  }
+}
+
+// Set up a decoder over a padded stream. Only codes longer than FAST_BITS
+// need a table off the stack, `fastTable`.
+static int openDecoder(struct Decoder *dec,
+    const struct SoftDeflateParams *params, const uint8_t *in, size_t bits,
+    struct HuffmanEntry *fastTable) {
+  dec->params = params;
+  dec->in = in;
+  dec->size = bits;
+  dec->pos = 0;
+  dec->tableBits = params->maxCodeLength > FAST_BITS ?
+    params->maxCodeLength : FAST_BITS;
+  dec->table = fastTable;
+  if(dec->tableBits > FAST_BITS) {
+    dec->table = (struct HuffmanEntry*)malloc(
+      sizeof(struct HuffmanEntry) << dec->tableBits);
+    if(!dec->table) return SD_OVERFLOW;
+  }
+  return SD_OK;
+}
+
+static void closeDecoder(struct Decoder *dec,
+    const struct HuffmanEntry *fastTable) {
+  if(dec->table != fastTable)
+    free(dec->table);
+}
+
+static int decode(const struct SoftDeflateParams *params, const uint8_t *in,
+    size_t bits, uint8_t *out, size_t outCap, size_t *outLen) {
+  struct Decoder dec;
+  struct HuffmanEntry fastTable[1 << FAST_BITS];
+  if(openDecoder(&dec, params, in, bits, fastTable))
+    return SD_OVERFLOW;
+  uint64_t tableMask = ((uint64_t)1 << dec.tableBits) - 1;
+  *outLen = 0;
+  
+  int charMax = (1 << params->characterBits) - 1;
+  int lengthMask = (1 << params->minEncodingLengthBits) - 1;
+  int addressBits = params->minEncodingChars * params->characterBits -
+    params->characterBits - 1 - params->minEncodingLengthBits;
+  
+  int err = readMetadata(&dec);
+  while(!err) {
+    // fast path: a run of literals
+    const struct HuffmanEntry *entry = &dec.table[peekWord(&dec) & tableMask];
+    if(entry->count && *outLen + FAST_CHARS <= outCap) {
+      int bits = entry->ends[entry->count - 1];
+      if((size_t)bits <= dec.size - dec.pos) {
+        memcpy(out + *outLen, entry->literals, FAST_CHARS);
+        *outLen += entry->count;
+        dec.pos += bits;
+        continue;
+      }
+    }
+    
+    int character;
+    err = readCharacter(&dec, &character);
+    if(err) break;
+    
+    if(character != params->escapeCharacter) {
+      if(*outLen == outCap) {err = SD_OVERFLOW; break;}
+      out[(*outLen)++] = character;
+      continue;
+    }
+    
+    int next;
+    err = readEncodingCharacter(&dec, &next);
+    if(err) break;
+    if(next == params->escapeCharacter) {
+      // doubled escape character is a literal
+      if(*outLen == outCap) {err = SD_OVERFLOW; break;}
+      out[(*outLen)++] = character;
+      continue;
+    }
+    
+    // encoding header: escape, confirmation bit, CAM address, length
+    uint64_t header = (uint64_t)character << params->characterBits | next;
+    for(int i = 2; i < params->minEncodingChars && !err; i++) {
+      err = readEncodingCharacter(&dec, &next);
+      header = header << params->characterBits | next;
+    }
+    if(err) break;
+    size_t address = header >> params->minEncodingLengthBits &
+      (((uint64_t)1 << addressBits) - 1);
+    size_t length = params->minCharsToEncode + (header & lengthMask);
+    
+    // an all-ones length continues into extra characters
+    if((int)(header & lengthMask) == lengthMask) {
+      do {
+        err = readEncodingCharacter(&dec, &next);
+        if(err) break;
+        length += next == charMax ?
+          params->extraCharacterLengthIncrease : next;
+      } while(next == charMax);
+      if(err) break;
+    }
+    
+    size_t distance = params->camSize - address;
+    if(address >= (size_t)params->camSize || distance > *outLen) {
+      err = SD_BAD_REFERENCE;
+      break;
+    }
+    if(length > outCap - *outLen) {err = SD_OVERFLOW; break;}
+    copyMatch(out, *outLen, distance, length, outCap);
+    *outLen += length;
+  }
+  
+  closeDecoder(&dec, fastTable);
+  return err < 0 ? SD_OK : err;
+}
+
+// Decode only the Huffman stage of a padded stream, giving the characters
+// the LZ stage produced.
+static int decodeHuffman(const struct SoftDeflateParams *params,
+    const uint8_t *in, size_t bits, uint8_t *out, size_t outCap,
+    size_t *outLen) {
+  struct Decoder dec;
+  struct HuffmanEntry fastTable[1 << FAST_BITS];
+  if(openDecoder(&dec, params, in, bits, fastTable))
+    return SD_OVERFLOW;
+  *outLen = 0;
+  int err = readMetadata(&dec);
+  while(!err) {
+    int character;
+    err = readCharacter(&dec, &character);
+    if(err) break;
+    if(*outLen == outCap) {err = SD_OVERFLOW; break;}
+    out[(*outLen)++] = character;
+  }
+  closeDecoder(&dec, fastTable);
+  return err < 0 ? SD_OK : err;
+}
+
+int sd_decompressBytes(const struct SoftDeflateParams *params,
+    const uint8_t *in, size_t bits, uint8_t *out, size_t outCap,
+    size_t *outLen) {
+  size_t bytes = (bits + 7) / 8;
+  uint8_t *padded = (uint8_t*)malloc(bytes + INPUT_PADDING);
+  if(!padded) return SD_OVERFLOW;
+  memcpy(padded, in, bytes);
+  memset(padded + bytes, 0, INPUT_PADDING);
+  // bits past the end of the stream read as zero
+  if(bits % 8)
+    padded[bytes - 1] &= (1 << bits % 8) - 1;
+  int err = decode(params, padded, bits, out, outCap, outLen);
+  free(padded);
+  return err;
+}
+
+int sd_decompress(const struct SoftDeflateParams *params,
+    const struct BitQueue *in, uint8_t *out, size_t outCap, size_t *outLen) {
+  size_t bytes = (bq_size(in) + 7) / 8;
+  uint8_t *padded = (uint8_t*)malloc(bytes + INPUT_PADDING);
+  if(!padded) return SD_OVERFLOW;
+  bq_copyOut(in, padded);
+  memset(padded + bytes, 0, INPUT_PADDING);
+  int err = decode(params, padded, bq_size(in), out, outCap, outLen);
+  free(padded);
+  return err;
+}
+
+int sd_huffmanDecode(const struct SoftDeflateParams *params,
+    const struct BitQueue *in, uint8_t *out, size_t outCap, size_t *outLen) {
+  size_t bytes = (bq_size(in) + 7) / 8;
+  uint8_t *padded = (uint8_t*)malloc(bytes + INPUT_PADDING);
+  if(!padded) return SD_OVERFLOW;
+  bq_copyOut(in, padded);
+  memset(padded + bytes, 0, INPUT_PADDING);
+  int err = decodeHuffman(params, padded, bq_size(in), out, outCap, outLen);
+  free(padded);
+  return err;
+}
+
+const char *sd_strerror(int err) {
+  switch(err) {
+  case SD_OK: return "success";
+  case SD_TRUNCATED: return "stream ends inside a symbol";
+  case SD_BAD_METADATA: return "malformed Huffman metadata";
+  case SD_BAD_CODE: return "no Huffman code matches";
+  case SD_BAD_REFERENCE: return "LZ reference before start of page";
+  case SD_OVERFLOW: return "output does not fit";
+  case SD_BAD_PARAMS: return "parameters not supported";
+  default: return "unknown error";
+  }
+}
+
+
+//==============================================================================
+// COMPRESSOR MODEL
+//------------------------------------------------------------------------------
+
+#define HASH_BITS 12
+
+void sd_initScratch(struct SoftDeflateScratch *scratch) {
+  scratch->chain = NULL;
+  scratch->chainCap = 0;
+  scratch->lz = NULL;
+  scratch->lzCap = 0;
+}
+
+void sd_freeScratch(struct SoftDeflateScratch *scratch) {
+  free(scratch->chain);
+  free(scratch->lz);
+  sd_initScratch(scratch);
+}
+
+// Grow a scratch buffer to hold `count` elements of `size` bytes. The old
+// buffer is kept if that fails.
+static int growScratch(void **buf, size_t *cap, size_t count, size_t size) {
+  if(count <= *cap)
+    return SD_OK;
+  void *grown = realloc(*buf, count * size);
+  if(!grown) return SD_OVERFLOW;
+  *buf = grown;
+  *cap = count;
+  return SD_OK;
+}
+
+static uint32_t hashChars(const uint8_t *data, int count) {
+  uint32_t value = 0;
+  if(count == 4)
+    memcpy(&value, data, 4);
+  else
+    for(int i = 0; i < count; i++)
+      value = value << 8 | data[i];
+  return value * 2654435761u >> (32 - HASH_BITS);
+}
+
+static size_t matchLength(const uint8_t *a, const uint8_t *b, size_t max) {
+  size_t length = 0;
+  while(length + 8 <= max) {
+    uint64_t x, y;
+    memcpy(&x, a + length, 8);
+    memcpy(&y, b + length, 8);
+    if(x != y)
+      return length + __builtin_ctzll(x ^ y) / 8;
+    length += 8;
+  }
+  while(length < max && a[length] == b[length])
+    length++;
+  return length;
+}
+
+// characters produced by LZGolden.encode for a match of `length`
+static size_t writeEncoding(const struct SoftDeflateParams *params,
+    size_t address, size_t length, uint8_t *out) {
+  int lengthMask = (1 << params->minEncodingLengthBits) - 1;
+  size_t maxCharsInMinEncoding = params->minCharsToEncode + lengthMask - 1;
+  int addressBits = params->minEncodingChars * params->characterBits -
+    params->characterBits - 1 - params->minEncodingLengthBits;
+  
+  uint64_t header = params->escapeCharacter;
+  header = header << 1 |
+    (~params->escapeCharacter >> (params->characterBits - 1) & 1);
+  header = header << addressBits | address;
+  header = header << params->minEncodingLengthBits |
+    (length <= maxCharsInMinEncoding ?
+      length - params->minCharsToEncode : (size_t)lengthMask);
+  size_t count = 0;
+  for(int i = params->minEncodingChars - 1; i >= 0; i--)
+    out[count++] = header >> (i * params->characterBits);
+  
+  if(length > maxCharsInMinEncoding) {
+    int charMax = (1 << params->characterBits) - 1;
+    long remaining = length - maxCharsInMinEncoding - 1;
+    for(; remaining >= 0; remaining -= params->extraCharacterLengthIncrease)
+      out[count++] = remaining < charMax ? remaining : charMax;
+  }
+  return count;
+}
+
+int sd_lzCompress(const struct SoftDeflateParams *params,
+    struct SoftDeflateScratch *scratch, const uint8_t *in, size_t len,
+    uint8_t *out, size_t outCap, size_t *outLen) {
+  if(outCap < 2 * len + params->minEncodingChars) return SD_OVERFLOW;
+  if(growScratch((void**)&scratch->chain, &scratch->chainCap, len ? len : 1,
+      sizeof(int32_t)))
+    return SD_OVERFLOW;
+  // Every match of at least minCharsToEncode starts with the same hashed
+  // prefix, so walking the chain finds exactly the matches LZGolden
+  // considers.
+  int hashCount = params->minCharsToEncode < 4 ? params->minCharsToEncode : 4;
+  int32_t head[1 << HASH_BITS];
+  int32_t *prev = scratch->chain;
+  memset(head, 0xff, sizeof(head));
+  
+  size_t count = 0;
+  size_t inserted = 0;
+  for(size_t pos = 0; pos < len;) {
+    size_t bestLength = 0, bestDistance = 0;
+    if(pos + params->minCharsToEncode <= len) {
+      size_t maxLength = len - pos;
+      if(maxLength > (size_t)params->maxCharsToEncode)
+        maxLength = params->maxCharsToEncode;
+      uint32_t hash = hashChars(in + pos, hashCount);
+      // most recent first, so only a strictly longer match replaces the best
+      for(int32_t p = head[hash];
+          p >= 0 && pos - p <= (size_t)params->camSize; p = prev[p]) {
+        if(bestLength && in[p + bestLength] != in[pos + bestLength])
+          continue;
+        size_t length = matchLength(in + p, in + pos, maxLength);
+        if(length > bestLength) {
+          bestLength = length;
+          bestDistance = pos - p;
+          if(length == maxLength)
+            break;
+        }
+      }
+    }
+    
+    size_t step = 1;
+    if(bestLength >= (size_t)params->minCharsToEncode) {
+      count += writeEncoding(params, params->camSize - bestDistance,
+        bestLength, out + count);
+      step = bestLength;
+    }
+    else {
+      out[count++] = in[pos];
+      if(in[pos] == params->escapeCharacter)
+        out[count++] = in[pos];
+    }
+    
+    pos += step;
+    for(; inserted < pos && inserted + hashCount <= len; inserted++) {
+      uint32_t hash = hashChars(in + inserted, hashCount);
+      prev[inserted] = head[hash];
+      head[hash] = inserted;
+    }
+  }
+  
+  *outLen = count;
+  return SD_OK;
+}
+
+// one code of the tree being built by TreeGenerator
+struct Leaf {
+  uint32_t code;
+  int length;
+  int root;
+};
+
+int sd_huffmanTree(const struct SoftDeflateParams *params,
+    const uint8_t *in, size_t len, struct SoftDeflateTree *tree) {
+  int codeCount = params->codeCount;
+  int maxCodeLength = params->maxCodeLength;
+  uint32_t codeMask = ((uint32_t)1 << maxCodeLength) - 1;
+  if(codeCount < 2 || codeCount > SD_MAX_CODE_COUNT)
+    return SD_BAD_PARAMS;
+  
+  // Counter: frequencies of the first passOneSize characters, keeping the
+  // codeCount - 1 most frequent. The RTL settles ties by the cycle in which
+  // characters arrive; here the lowest character wins (see SoftDeflate.h).
+  size_t frequencies[256] = {0};
+  size_t total = len < (size_t)params->passOneSize ?
+    len : (size_t)params->passOneSize;
+  for(size_t i = 0; i < total; i++)
+    frequencies[in[i]]++;
+  int high[SD_MAX_CODE_COUNT];
+  size_t roots[SD_MAX_CODE_COUNT];
+  struct Leaf leafBufs[2][SD_MAX_CODE_COUNT];
+  struct Leaf *leaves = leafBufs[0];
+  struct Leaf *next = leafBufs[1];
+  // insertion into a list sorted by descending frequency; a character only
+  // displaces strictly less frequent ones
+  int highCount = 0;
+  for(int c = 0; c < 256; c++) {
+    size_t freq = frequencies[c];
+    if(!freq) continue;
+    int i = highCount;
+    if(highCount < codeCount - 1)
+      highCount++;
+    else if(freq > frequencies[high[codeCount - 2]])
+      i = codeCount - 2;
+    else
+      continue;
+    for(; i > 0 && frequencies[high[i - 1]] < freq; i--)
+      high[i] = high[i - 1];
+    high[i] = c;
+  }
+  size_t highTotal = 0;
+  for(int i = 0; i < codeCount - 1; i++) {
+    if(i >= highCount)
+      high[i] = -1;
+    roots[i] = high[i] < 0 ? 0 : frequencies[high[i]];
+    highTotal += roots[i];
+  }
+  // the escape always gets a code
+  roots[codeCount - 1] = highTotal != total ? total - highTotal : 1;
+  for(int i = 0; i < codeCount; i++) {
+    leaves[i].code = 0;
+    leaves[i].length = 0;
+    leaves[i].root = i;
+  }
+  
+  // TreeGenerator: merge the two least frequent roots (lowest index on ties)
+  // until one remains
+  for(;;) {
+    int a = -1, b = -1;
+    for(int i = 0; i < codeCount; i++) {
+      if(!roots[i]) continue;
+      if(a < 0 || roots[i] < roots[a]) {
+        b = a;
+        a = i;
+      }
+      else if(b < 0 || roots[i] < roots[b]) {
+        b = i;
+      }
+    }
+    if(b < 0) break;
+    roots[a] += roots[b];
+    roots[b] = 0;
+    
+    const struct Leaf *escape = &leaves[codeCount - 1];
+    for(int i = 0; i < codeCount; i++) {
+      const struct Leaf *l = &leaves[i];
+      struct Leaf *n = &next[i];
+      *n = *l;
+      if(l->root == a) {
+        n->code = l->code << 1 & codeMask;
+        n->length = l->length + 1;
+      }
+      if(l->root == b) {
+        n->code = (l->code << 1 | 1) & codeMask;
+        n->length = l->length + 1;
+        n->root = a;
+      }
+      // depth truncation: a full-length code is dropped unless it is the
+      // escape or shadows the escape code
+      if((l->root == a || l->root == b) && l->length == maxCodeLength) {
+        if((!(l->code >> (maxCodeLength - 1) & 1) ||
+            (l->code & codeMask >> 1) != escape->code) &&
+            i != codeCount - 1) {
+          n->length = 0;
+          n->root = b;
+        }
+        else {
+          n->length = maxCodeLength;
+        }
+      }
+    }
+    struct Leaf *swap = leaves;
+    leaves = next;
+    next = swap;
+  }
+  
+  memset(tree->length, 0, sizeof(tree->length));
+  for(int i = 0; i < codeCount - 1; i++) {
+    if(high[i] < 0) continue;
+    tree->length[high[i]] = leaves[i].length;
+    tree->code[high[i]] = leaves[i].code;
+  }
+  tree->escapeLength = leaves[codeCount - 1].length;
+  tree->escapeCode = leaves[codeCount - 1].code;
+  // An empty page leaves the escape as the only root, with no bits. A zero
+  // length would end the metadata, so give it one bit.
+  if(!tree->escapeLength)
+    tree->escapeLength = 1;
+  return SD_OK;
+}
+
+size_t sd_huffmanBits(const struct SoftDeflateParams *params,
+    const struct SoftDeflateTree *tree, const uint8_t *in, size_t len) {
+  int lengthBits = valBits(params->maxCodeLength);
+  
+  // escape code, character codes, then a zero length
+  size_t bits = lengthBits + tree->escapeLength + lengthBits;
+  size_t symbolBits[256];
+  for(int c = 0; c < 256; c++) {
+    if(tree->length[c]) {
+      bits += lengthBits + params->characterBits + tree->length[c];
+      symbolBits[c] = tree->length[c];
+    }
+    else {
+      symbolBits[c] = tree->escapeLength + params->characterBits;
+    }
+  }
+  
+  for(size_t i = 0; i < len; i++)
+    bits += symbolBits[in[i]];
+  return bits;
+}
+
+// the LZ stage of a page into the scratch buffer
+static int lzStage(const struct SoftDeflateParams *params,
+    struct SoftDeflateScratch *scratch, const uint8_t *in, size_t len,
+    size_t *lzLen) {
+  size_t cap = 2 * len + params->minEncodingChars;
+  if(growScratch((void**)&scratch->lz, &scratch->lzCap, cap, 1))
+    return SD_OVERFLOW;
+  return sd_lzCompress(params, scratch, in, len, scratch->lz, cap, lzLen);
+}
+
+int sd_estimate(const struct SoftDeflateParams *params,
+    struct SoftDeflateScratch *scratch, const uint8_t *in, size_t len,
+    size_t *bits) {
+  size_t lzLen;
+  int err = lzStage(params, scratch, in, len, &lzLen);
+  if(err) return err;
+  struct SoftDeflateTree tree;
+  err = sd_huffmanTree(params, scratch->lz, lzLen, &tree);
+  if(err) return err;
+  *bits = sd_huffmanBits(params, &tree, scratch->lz, lzLen);
+  return SD_OK;
+}
+
+// collects bits in a word and pushes them onto the queue when it fills
+struct BitWriter {
+  struct BitQueue *queue;
+  uint64_t word;
+  int count;
+};
+
+static void writeBits(struct BitWriter *writer, uint64_t value, int count) {
+  if(writer->count + count > 64) {
+    bq_pushBits(writer->queue, writer->word, writer->count);
+    writer->word = 0;
+    writer->count = 0;
+  }
+  if(count)
+    writer->word |= value << writer->count;
+  writer->count += count;
+}
+
+int sd_compress(const struct SoftDeflateParams *params,
+    struct SoftDeflateScratch *scratch, const uint8_t *in, size_t len,
+    struct BitQueue *out) {
+  size_t lzLen;
+  int err = lzStage(params, scratch, in, len, &lzLen);
+  if(err) return err;
+  const uint8_t *lz = scratch->lz;
+  struct SoftDeflateTree tree;
+  err = sd_huffmanTree(params, lz, lzLen, &tree);
+  if(err) return err;
+  
+  // When TreeGenerator truncates the tree it can give the escape's sibling
+  // the escape code, which no decoder can tell apart. Escape that character
+  // instead.
+  for(int c = 0; c < 256; c++)
+    if(tree.length[c] && tree.length[c] == tree.escapeLength &&
+        tree.code[c] == tree.escapeCode)
+      tree.length[c] = 0;
+  
+  bq_clear(out);
+  if(bq_reserve(out, sd_huffmanBits(params, &tree, lz, lzLen)))
+    return SD_OVERFLOW;
+  struct BitWriter writer = {out, 0, 0};
+  int lengthBits = valBits(params->maxCodeLength);
+  
+  // metadata: escape code, character codes, then a zero length
+  writeBits(&writer, tree.escapeLength, lengthBits);
+  writeBits(&writer, tree.escapeCode, tree.escapeLength);
+  uint64_t symbol[256];
+  int symbolBits[256];
+  for(int c = 0; c < 256; c++) {
+    if(tree.length[c]) {
+      writeBits(&writer, tree.length[c], lengthBits);
+      writeBits(&writer, c, params->characterBits);
+      writeBits(&writer, tree.code[c], tree.length[c]);
+      symbol[c] = tree.code[c];
+      symbolBits[c] = tree.length[c];
+    }
+    else {
+      symbol[c] = tree.escapeCode | (uint64_t)c << tree.escapeLength;
+      symbolBits[c] = tree.escapeLength + params->characterBits;
+    }
+  }
+  writeBits(&writer, 0, lengthBits);
+  
+  for(size_t i = 0; i < lzLen; i++)
+    writeBits(&writer, symbol[lz[i]], symbolBits[lz[i]]);
+  bq_pushBits(out, writer.word, writer.count);
+  return SD_OK;
+}
+
+
+//==============================================================================
+// BATCHES
+//------------------------------------------------------------------------------
+
+struct Batch {
+  const struct SoftDeflateParams *params;
+  struct SoftDeflatePage *pages;
+  size_t count;
+  size_t next;
+  bool compress;
+};
+
+static void *runBatch(void *arg) {
+  struct Batch *batch = (struct Batch*)arg;
+  // one scratch per thread, reused by all its pages
+  struct SoftDeflateScratch scratch;
+  sd_initScratch(&scratch);
+  for(;;) {
+    size_t i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+    if(i >= batch->count) break;
+    struct SoftDeflatePage *page = &batch->pages[i];
+    if(batch->compress)
+      page->err = sd_compress(batch->params, &scratch, page->data, page->len,
+        &page->compressed);
+    else
+      page->err = sd_decompress(batch->params, &page->compressed,
+        page->data, page->cap, &page->len);
+  }
+  sd_freeScratch(&scratch);
+  return NULL;
+}
+
+// run a batch on the calling thread and `threads - 1` others
+static void spreadBatch(struct Batch *batch, int threads) {
+  pthread_t *ids = (pthread_t*)malloc(sizeof(pthread_t) *
+    (threads > 1 ? threads - 1 : 1));
+  int started = 0;
+  for(; ids && started < threads - 1; started++)
+    if(pthread_create(&ids[started], NULL, runBatch, batch))
+      break;
+  runBatch(batch);
+  for(int i = 0; i < started; i++)
+    pthread_join(ids[i], NULL);
+  free(ids);
+}
+
+void sd_compressBatch(const struct SoftDeflateParams *params,
+    struct SoftDeflatePage *pages, size_t count, int threads) {
+  struct Batch batch = {params, pages, count, 0, true};
+  spreadBatch(&batch, threads);
+}
+
+void sd_decompressBatch(const struct SoftDeflateParams *params,
+    struct SoftDeflatePage *pages, size_t count, int threads) {
+  struct Batch batch = {params, pages, count, 0, false};
+  spreadBatch(&batch, threads);
+}
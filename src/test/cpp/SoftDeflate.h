@@ -0,0 +1,188 @@
+#ifndef SOFTDEFLATE_H
+#define SOFTDEFLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "BitQueue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A software model of DeflateDecompressor. It decodes the Huffman stream
+// (metadata, then codes and escaped characters, LSB first) and feeds the
+// characters straight into the LZ decoder (literals, doubled escape
+// characters, and escape-prefixed CAM references with extended lengths as
+// produced by LZGolden.encode). Output is bit-exact with the RTL for any
+// stream the compressor produces.
+//
+// The compressor side writes the same format, or just predicts how many
+// bits DeflateCompressor emits for a page without simulating it. LZ matching
+// follows LZGolden (greedy longest match, most recent on ties), so the LZ
+// stage matches LZCompressor character for character. The Huffman codes are
+// built like Counter and TreeGenerator, including depth truncation, but the
+// Counter settles characters of equal frequency in the order they arrive,
+// which depends on LZ timing the model does not have; here the lowest
+// character wins. Where such ties decide which characters get codes or how
+// the tree is merged, the stream differs from DeflateCompressor's and its size
+// is an estimate; it always decodes to the same page. `--compare-soft` of the
+// Deflate harness checks both claims against the RTL.
+
+struct SoftDeflateParams {
+  int characterBits;
+  // LZ
+  int escapeCharacter;
+  int camSize;
+  int minCharsToEncode;
+  int maxCharsToEncode;
+  int minEncodingChars;
+  int minEncodingLengthBits;
+  int extraCharacterLengthIncrease;
+  // Huffman
+  int codeCount;
+  int maxCodeLength;
+  int passOneSize;
+};
+
+// Huffman codes chosen by the compressor for a page, indexed by character.
+// A character with a zero length has no code and is escaped.
+struct SoftDeflateTree {
+  uint8_t length[256];
+  uint32_t code[256];
+  int escapeLength;
+  uint32_t escapeCode;
+};
+
+#define SD_OK 0
+// the stream ended in the middle of a symbol, header or encoding
+#define SD_TRUNCATED 1
+// the Huffman metadata is malformed
+#define SD_BAD_METADATA 2
+// the bits at the read position match no Huffman code
+#define SD_BAD_CODE 3
+// an LZ encoding points before the start of the page
+#define SD_BAD_REFERENCE 4
+// the output does not fit in the buffer
+#define SD_OVERFLOW 5
+// the parameters are outside what the model handles
+#define SD_BAD_PARAMS 6
+
+// most Huffman codes there may be: every 8-bit character and the escape
+#define SD_MAX_CODE_COUNT 257
+
+// Decompress a whole page. Returns one of the SD_ codes; `outLen` holds the
+// number of characters written so far even on failure.
+extern int sd_decompress(const struct SoftDeflateParams *params,
+  const struct BitQueue *in, uint8_t *out, size_t outCap, size_t *outLen);
+
+// Same, for a stream of `bits` bits stored LSB first in bytes.
+extern int sd_decompressBytes(const struct SoftDeflateParams *params,
+  const uint8_t *in, size_t bits, uint8_t *out, size_t outCap,
+  size_t *outLen);
+
+// Decode only the Huffman stage of a stream, giving the characters of the LZ
+// stage (the output of sd_lzCompress, for streams of the same hardware).
+extern int sd_huffmanDecode(const struct SoftDeflateParams *params,
+  const struct BitQueue *in, uint8_t *out, size_t outCap, size_t *outLen);
+
+// Working memory of the compressor, grown to the largest page seen so far.
+// Keeping one per thread saves allocating it for every page.
+struct SoftDeflateScratch {
+  int32_t *chain;
+  size_t chainCap;
+  uint8_t *lz;
+  size_t lzCap;
+};
+
+extern void sd_initScratch(struct SoftDeflateScratch *scratch);
+extern void sd_freeScratch(struct SoftDeflateScratch *scratch);
+
+// Compress a whole page, replacing the contents of `out`. Returns SD_OK,
+// SD_OVERFLOW if memory runs out, or SD_BAD_PARAMS.
+extern int sd_compress(const struct SoftDeflateParams *params,
+  struct SoftDeflateScratch *scratch, const uint8_t *in, size_t len,
+  struct BitQueue *out);
+
+// A page of a batch. Compression reads `len` characters of `data`;
+// decompression writes up to `cap` characters to `data` and sets `len`.
+struct SoftDeflatePage {
+  uint8_t *data;
+  size_t len;
+  size_t cap;
+  struct BitQueue compressed;
+  // SD_ code of the last operation
+  int err;
+};
+
+// Compress or decompress every page of a batch, spread over `threads`
+// threads including the caller.
+extern void sd_compressBatch(const struct SoftDeflateParams *params,
+  struct SoftDeflatePage *pages, size_t count, int threads);
+extern void sd_decompressBatch(const struct SoftDeflateParams *params,
+  struct SoftDeflatePage *pages, size_t count, int threads);
+
+extern const char *sd_strerror(int err);
+
+// Run the LZ stage over `len` characters. The output never needs more than
+// 2 * len + minEncodingChars characters. Returns SD_OK or SD_OVERFLOW.
+extern int sd_lzCompress(const struct SoftDeflateParams *params,
+  struct SoftDeflateScratch *scratch, const uint8_t *in, size_t len,
+  uint8_t *out, size_t outCap, size_t *outLen);
+
+// Build the codes the Huffman stage would use for these characters. Returns
+// SD_OK, or SD_BAD_PARAMS for more than SD_MAX_CODE_COUNT codes.
+extern int sd_huffmanTree(const struct SoftDeflateParams *params,
+  const uint8_t *in, size_t len, struct SoftDeflateTree *tree);
+
+// Number of bits the Huffman stage emits for these characters, including
+// the metadata.
+extern size_t sd_huffmanBits(const struct SoftDeflateParams *params,
+  const struct SoftDeflateTree *tree, const uint8_t *in, size_t len);
+
+// Predicted size in bits of a compressed page. Returns SD_OK, SD_OVERFLOW if
+// a scratch buffer cannot be grown, or SD_BAD_PARAMS.
+extern int sd_estimate(const struct SoftDeflateParams *params,
+  struct SoftDeflateScratch *scratch, const uint8_t *in, size_t len,
+  size_t *bits);
+
+// Why pages of `pageSize` bytes leave part of the hardware unused, or NULL.
+// Any page size works; a zero parameter stands for a stage the hardware
+// does not have.
+static inline const char *sd_pageSizeMismatch(int camSize,
+    int maxCharsToEncode, int passOneSize, size_t pageSize) {
+  if(camSize && pageSize < (size_t)camSize)
+    return "pages are smaller than the LZ history (camSize)";
+  if(maxCharsToEncode && pageSize < (size_t)maxCharsToEncode)
+    return "pages are shorter than the longest LZ match (maxCharsToEncode)";
+  if(passOneSize && pageSize > 2 * (size_t)passOneSize)
+    return "Huffman codes are built from under half of each page "
+      "(passOneSize)";
+  return NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+// parameters of the generated hardware, if its header is included
+#ifdef DEFLATE_LZ_CAM_SIZE
+static inline struct SoftDeflateParams sd_generatedParams() {
+  struct SoftDeflateParams params;
+  params.characterBits = DEFLATE_CHARACTER_BITS;
+  params.escapeCharacter = DEFLATE_LZ_ESCAPE_CHARACTER;
+  params.camSize = DEFLATE_LZ_CAM_SIZE;
+  params.minCharsToEncode = DEFLATE_LZ_MIN_CHARS_TO_ENCODE;
+  params.maxCharsToEncode = DEFLATE_LZ_MAX_CHARS_TO_ENCODE;
+  params.minEncodingChars = DEFLATE_LZ_MIN_ENCODING_CHARS;
+  params.minEncodingLengthBits = DEFLATE_LZ_MIN_ENCODING_LENGTH_BITS;
+  params.extraCharacterLengthIncrease =
+    DEFLATE_LZ_EXTRA_CHARACTER_LENGTH_INCREASE;
+  params.codeCount = DEFLATE_HUFFMAN_CODE_COUNT;
+  params.maxCodeLength = DEFLATE_HUFFMAN_MAX_CODE_LENGTH;
+  params.passOneSize = DEFLATE_HUFFMAN_PASS_ONE_SIZE;
+  return params;
+}
+#endif
+
+#endif
@@ -0,0 +1,255 @@
+#ifndef SOFTDEFLATE_CONFIG_H
+#define SOFTDEFLATE_CONFIG_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "SoftDeflate.h"
+
+// Configurations and dumps for the software tools. A configuration is a
+// deflate.csv file (which names the lz.csv and huffman.csv files, relative to
+// the working directory like the generators) optionally followed by
+// comma-separated overrides, e.g.
+//   configFiles/deflate.csv,lz.camSize=2040,huffman.codeCount=32
+
+#define MAX_SETTINGS 64
+#define MAX_KEY 64
+#define MAX_VALUE 256
+
+struct Settings {
+  int count;
+  char key[MAX_SETTINGS][MAX_KEY];
+  char value[MAX_SETTINGS][MAX_VALUE];
+};
+
+struct Config {
+  const char *spec;
+  struct SoftDeflateParams params;
+};
+
+struct Dump {
+  const char *path;
+  uint8_t *map;
+  size_t size;
+  // index of the first page of this dump among the pages of all dumps
+  size_t firstPage;
+};
+
+
+static inline void setSetting(struct Settings *settings, const char *key,
+    const char *value) {
+  int i = 0;
+  while(i < settings->count && strcmp(settings->key[i], key))
+    i++;
+  if(i == settings->count) {
+    assert(settings->count < MAX_SETTINGS);
+    settings->count++;
+  }
+  snprintf(settings->key[i], MAX_KEY, "%s", key);
+  snprintf(settings->value[i], MAX_VALUE, "%s", value);
+}
+
+static inline const char *getSetting(const struct Settings *settings,
+    const char *key) {
+  for(int i = 0; i < settings->count; i++)
+    if(!strcmp(settings->key[i], key))
+      return settings->value[i];
+  return NULL;
+}
+
+static inline char *trim(char *s) {
+  while(*s == ' ' || *s == '\t')
+    s++;
+  char *end = s + strlen(s);
+  while(end > s && strchr(" \t\r\n", end[-1]))
+    end--;
+  *end = '\0';
+  return s;
+}
+
+// read "name, value" lines the way Parameters.fromCSV does
+static inline bool readCsv(struct Settings *settings, const char *path,
+    const char *prefix) {
+  FILE *file = fopen(path, "r");
+  if(!file) {
+    fprintf(stderr, "error: cannot open %s\n", path);
+    return false;
+  }
+  char line[MAX_KEY + MAX_VALUE];
+  while(fgets(line, sizeof(line), file)) {
+    char *comma = strchr(line, ',');
+    char *rest = trim(line);
+    if(!*rest) continue;
+    if(!comma || strchr(comma + 1, ',')) {
+      fprintf(stderr, "warning: %s: line '%s' does not have exactly two "
+        "values\n", path, rest);
+      continue;
+    }
+    *comma = '\0';
+    char key[MAX_KEY];
+    snprintf(key, MAX_KEY, "%s%s", prefix, trim(line));
+    setSetting(settings, key, trim(comma + 1));
+  }
+  fclose(file);
+  return true;
+}
+
+static inline bool intSetting(const struct Settings *settings, const char *key,
+    int *value) {
+  const char *s = getSetting(settings, key);
+  if(!s) {
+    fprintf(stderr, "error: missing parameter %s\n", key);
+    return false;
+  }
+  *value = atoi(s);
+  return true;
+}
+
+// bits needed to index `count` values
+static inline int idxBits(int count) {
+  int bits = 0;
+  while(((long)1 << bits) < count)
+    bits++;
+  return bits;
+}
+
+// Load a configuration spec and derive the parameters the same way the lz
+// and huffman Parameters classes do.
+static inline bool loadConfig(struct Config *config, const char *spec) {
+  config->spec = spec;
+  char path[MAX_VALUE];
+  snprintf(path, sizeof(path), "%s", spec);
+  char *overrides = strchr(path, ',');
+  if(overrides)
+    *overrides++ = '\0';
+  
+  struct Settings deflate, settings;
+  deflate.count = 0;
+  settings.count = 0;
+  if(!readCsv(&deflate, path, "")) return false;
+  const char *lzPath = getSetting(&deflate, "lz");
+  const char *huffmanPath = getSetting(&deflate, "huffman");
+  if(!lzPath || !huffmanPath) {
+    fprintf(stderr, "error: %s must name lz and huffman files\n", path);
+    return false;
+  }
+  if(!readCsv(&settings, lzPath, "lz.")) return false;
+  if(!readCsv(&settings, huffmanPath, "huffman.")) return false;
+  
+  while(overrides && *overrides) {
+    char *next = strchr(overrides, ',');
+    if(next)
+      *next++ = '\0';
+    char *equals = strchr(overrides, '=');
+    if(!equals) {
+      fprintf(stderr, "error: %s: override %s is not key=value\n", spec,
+        overrides);
+      return false;
+    }
+    *equals = '\0';
+    char *key = trim(overrides);
+    if(!getSetting(&settings, key)) {
+      fprintf(stderr, "error: %s: unknown parameter %s\n", spec, key);
+      return false;
+    }
+    setSetting(&settings, key, trim(equals + 1));
+    overrides = next;
+  }
+  
+  struct SoftDeflateParams *p = &config->params;
+  int huffmanCharacterBits;
+  if(!intSetting(&settings, "lz.characterBits", &p->characterBits) ||
+      !intSetting(&settings, "lz.escapeCharacter", &p->escapeCharacter) ||
+      !intSetting(&settings, "lz.camSize", &p->camSize) ||
+      !intSetting(&settings, "lz.minCharsToEncode", &p->minCharsToEncode) ||
+      !intSetting(&settings, "lz.maxCharsToEncode", &p->maxCharsToEncode) ||
+      !intSetting(&settings, "huffman.characterBits",
+        &huffmanCharacterBits) ||
+      !intSetting(&settings, "huffman.codeCount", &p->codeCount) ||
+      !intSetting(&settings, "huffman.maxCodeLength", &p->maxCodeLength) ||
+      !intSetting(&settings, "huffman.passOneSize", &p->passOneSize))
+    return false;
+  
+  int camIdxBits = idxBits(p->camSize);
+  p->minEncodingChars =
+    (p->characterBits + 1 + camIdxBits) / p->characterBits + 1;
+  p->minEncodingLengthBits = p->minEncodingChars * p->characterBits -
+    p->characterBits - 1 - camIdxBits;
+  p->extraCharacterLengthIncrease = (1 << p->characterBits) - 1;
+  
+  const char *problem = NULL;
+  if(p->characterBits != 8 || huffmanCharacterBits != 8)
+    problem = "only 8-bit characters are supported";
+  else if(p->escapeCharacter < 0 || p->escapeCharacter > 255)
+    problem = "escapeCharacter not representable in a character";
+  else if(p->camSize < 1 || p->minCharsToEncode < 1 ||
+      p->maxCharsToEncode < p->minCharsToEncode)
+    problem = "bad CAM parameters";
+  else if(p->minEncodingChars * p->characterBits > 64)
+    problem = "camSize too large";
+  else if(p->codeCount < 2 || p->codeCount > 257)
+    problem = "codeCount must be between 2 and 257";
+  else if(p->maxCodeLength < 2 || p->maxCodeLength > 31)
+    problem = "maxCodeLength must be between 2 and 31";
+  else if(p->passOneSize < 1)
+    problem = "passOneSize must be positive";
+  if(problem) {
+    fprintf(stderr, "error: %s: %s\n", spec, problem);
+    return false;
+  }
+  return true;
+}
+
+// warn when a configuration leaves part of its hardware unused on pages of
+// `pageSize` bytes
+static inline void checkPageSize(const struct Config *config,
+    size_t pageSize) {
+  const struct SoftDeflateParams *p = &config->params;
+  const char *mismatch = sd_pageSizeMismatch(p->camSize, p->maxCharsToEncode,
+    p->passOneSize, pageSize);
+  if(mismatch)
+    fprintf(stderr, "warning: %s: %lu-byte pages: %s\n", config->spec,
+      pageSize, mismatch);
+}
+
+static inline bool openDump(struct Dump *dump, const char *path) {
+  dump->path = path;
+  dump->map = NULL;
+  dump->size = 0;
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if(fd < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+    fprintf(stderr, "error: %s is not a readable file\n", path);
+    if(fd >= 0) close(fd);
+    return false;
+  }
+  dump->size = st.st_size;
+  if(dump->size > 0) {
+    void *map = mmap(NULL, dump->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED) {
+      fprintf(stderr, "error: cannot map %s\n", path);
+      close(fd);
+      return false;
+    }
+    madvise(map, dump->size, MADV_SEQUENTIAL);
+    dump->map = (uint8_t*)map;
+  }
+  close(fd);
+  return true;
+}
+
+static inline void closeDump(struct Dump *dump) {
+  if(dump->map)
+    munmap(dump->map, dump->size);
+  dump->map = NULL;
+}
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef STREAM_HARNESS_H
+#define STREAM_HARNESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <type_traits>
+#include "BitQueue.h"
+#include "LanePack.h"
+
+// Driving the stream ports of a Verilated module. Each port is exposed as
+// `io_*_ready`, `io_*_valid`, `io_*_last` and consecutive data fields
+// `io_*_data_0`, `io_*_data_1`, ..., one per lane.
+
+// Lanes carrying one character each. Characters are kept in byte buffers, or
+// in a BitQueue 8 bits at a time when they are the compressed stream (LZ).
+struct CharLane {
+  static size_t count(const struct BitQueue *queue) {
+    return bq_size(queue) / 8;
+  }
+
+  static void read(const uint8_t *buf, size_t offset, uint8_t *lanes,
+      int n) {
+    memcpy(lanes, buf + offset, n);
+  }
+
+  static void read(const struct BitQueue *queue, size_t offset,
+      uint8_t *lanes, int n) {
+    for(int i = 0; i < n; i++) {
+      uint64_t c;
+      char err = bq_peekBits(queue, (offset + i) * 8, &c, 8);
+      assert(!err);
+      lanes[i] = c;
+    }
+  }
+
+  static void write(uint8_t *buf, const uint8_t *lanes, int n) {
+    memcpy(buf, lanes, n);
+  }
+
+  static void write(struct BitQueue *queue, const uint8_t *lanes, int n) {
+    for(int i = 0; i < n; i++) {
+      char err = bq_pushBits(queue, lanes[i], 8);
+      assert(!err);
+    }
+  }
+};
+
+// Lanes carrying one bit each, held as 0 or 1
+struct BitLane {
+  static size_t count(const struct BitQueue *queue) {
+    return bq_size(queue);
+  }
+
+  static void read(const struct BitQueue *queue, size_t offset,
+      uint8_t *lanes, int n) {
+    queueToLanes(queue, offset, lanes, n);
+  }
+
+  static void write(struct BitQueue *queue, const uint8_t *lanes, int n) {
+    lanesToQueue(queue, lanes, n);
+  }
+};
+
+// One module with an input stream of `InLanes` lanes of `InLane` and an
+// output stream of `OutLanes` lanes of `OutLane`, both counts being the
+// constants from the generated parameter header.
+//
+// Modules with restartable streams (`io_in_restart`, `io_out_restart`) take
+// one page after another. The others handle a single page and are reset
+// once its output has been taken, so a page enters and leaves together.
+template<class VModule, class InLane, class OutLane, int InLanes,
+  int OutLanes, bool Restartable>
+struct StreamHarness {
+  typedef VModule Module;
+  typedef InLane In;
+  typedef OutLane Out;
+  static const int inLanes = InLanes;
+  static const int outLanes = OutLanes;
+  static const bool restartable = Restartable;
+
+  static uint8_t *inData(VModule *module) {
+    // module input is not in array form, so must use an ugly cast
+    return &module->io_in_data_0;
+  }
+
+  static uint8_t *outData(VModule *module) {
+    return &module->io_out_data_0;
+  }
+
+  // Offer up to `InLanes` of the `remaining` lanes of the input page, or
+  // nothing when there is no page (`closed`). The caller fills `inData()`
+  // with the returned number of lanes.
+  static int driveIn(VModule *module, size_t remaining, bool closed) {
+    if(closed) {
+      module->io_in_valid = 0;
+      module->io_in_last = false;
+      return 0;
+    }
+    module->io_in_valid = remaining < InLanes ? remaining : InLanes;
+    module->io_in_last = remaining <= InLanes;
+    return module->io_in_valid;
+  }
+
+  static void driveOut(VModule *module) {
+    module->io_out_ready = OutLanes;
+    clearRestart(module, std::integral_constant<bool, Restartable>());
+  }
+
+  // lanes transferred this cycle, once outputs are evaluated
+  static size_t takenIn(VModule *module) {
+    return module->io_in_valid < module->io_in_ready ?
+      module->io_in_valid : module->io_in_ready;
+  }
+
+  static size_t takenOut(VModule *module) {
+    return module->io_out_valid < module->io_out_ready ?
+      module->io_out_valid : module->io_out_ready;
+  }
+
+  // Whether the output page ends this cycle, i.e. its last lanes are taken.
+  // Restartable modules are told so through `io_out_restart`.
+  static bool endOut(VModule *module) {
+    bool end = module->io_out_last &&
+      module->io_out_ready >= module->io_out_valid;
+    setRestart(module, end, std::integral_constant<bool, Restartable>());
+    return end;
+  }
+
+  // whether the module is done with its input page this cycle
+  static bool endIn(VModule *module, bool outEnded) {
+    return inRestart(module, outEnded,
+      std::integral_constant<bool, Restartable>());
+  }
+
+  // Called before the rising edge. A module without restart is reset on the
+  // edge that ends its page.
+  static void beforeEdge(VModule *module, bool outEnded) {
+    if(!Restartable && outEnded)
+      module->reset = 1;
+  }
+
+  static void afterEdge(VModule *module) {
+    if(!Restartable)
+      module->reset = 0;
+  }
+
+private:
+  // the unused overloads are never instantiated, so modules without restart
+  // ports compile
+  template<class M>
+  static void clearRestart(M *module, std::true_type) {
+    module->io_out_restart = false;
+  }
+  template<class M>
+  static void clearRestart(M *module, std::false_type) {}
+
+  template<class M>
+  static void setRestart(M *module, bool end, std::true_type) {
+    module->io_out_restart = end;
+  }
+  template<class M>
+  static void setRestart(M *module, bool end, std::false_type) {}
+
+  template<class M>
+  static bool inRestart(M *module, bool outEnded, std::true_type) {
+    return module->io_in_restart;
+  }
+  template<class M>
+  static bool inRestart(M *module, bool outEnded, std::false_type) {
+    return outEnded;
+  }
+};
+
+#endif
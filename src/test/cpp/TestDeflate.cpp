@@ -7,6 +7,26 @@
 #include <string.h>
 #include <assert.h>
 #include <limits.h>
+#include <math.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "BitQueue.h"
+#include "PageScan.h"
+#include "SoftDeflate.h"
+#include "LanePack.h"
+#include "StreamHarness.h"
+#include "Results.h"
+#include "Archive.h"
+#include "AccessTrace.h"
 
 
 // <editor-fold> ugly pre-processor macros
@@ -16,11 +36,74 @@
 #define CAT(s,t) _CAT(s,t)
 // </editor-fold>
 
-#ifndef COMPRESSOR
-#define COMPRESSOR DeflateCompressor
+// The harness is built once per pair of modules (see the Test* tasks in
+// build.gradle). STREAM selects the pair, whose generated parameter header is
+// included on the command line.
+#define STREAM_LZ 1
+#define STREAM_HUFFMAN 2
+#define STREAM_DEFLATE 3
+#ifndef STREAM
+#define STREAM STREAM_DEFLATE
 #endif
-#ifndef DECOMPRESSOR
-#define DECOMPRESSOR DeflateDecompressor
+
+#if STREAM == STREAM_LZ
+  #define COMPRESSOR LZCompressor
+  #define DECOMPRESSOR LZDecompressor
+  // LZ output is characters; its streams have no restart
+  #define COMPRESSED_LANE CharLane
+  #define COMPRESSED_LANE_BITS 8
+  #define COMPRESSOR_CHARS_IN LZ_COMPRESSOR_CHARS_IN
+  #define COMPRESSOR_LANES_OUT LZ_COMPRESSOR_CHARS_OUT
+  #define DECOMPRESSOR_LANES_IN LZ_DECOMPRESSOR_CHARS_IN
+  #define DECOMPRESSOR_CHARS_OUT LZ_DECOMPRESSOR_CHARS_OUT
+  #define RESTARTABLE false
+  #define SOFT_CODEC false
+  // hardware limits the page size is checked against (0 for no such stage)
+  #define LIMIT_CAM_SIZE LZ_CAM_SIZE
+  #define LIMIT_MAX_CHARS_TO_ENCODE LZ_MAX_CHARS_TO_ENCODE
+  #define LIMIT_PASS_ONE_SIZE 0
+  // compressor pipeline stages with an occupancy port (see StageState.scala),
+  // as X(name, port)
+  #define COMPRESSOR_STAGES(X) X("cam", debug_cam) X("encoder", debug_encoder)
+  #define NUM_COMPRESSOR_STAGES 2
+#elif STREAM == STREAM_HUFFMAN
+  #define COMPRESSOR HuffmanCompressor
+  #define DECOMPRESSOR HuffmanDecompressor
+  #define COMPRESSED_LANE BitLane
+  #define COMPRESSED_LANE_BITS 1
+  #define COMPRESSOR_CHARS_IN HUFFMAN_COMPRESSOR_CHARS_IN
+  #define COMPRESSOR_LANES_OUT HUFFMAN_COMPRESSOR_BITS_OUT
+  #define DECOMPRESSOR_LANES_IN HUFFMAN_DECOMPRESSOR_BITS_IN
+  #define DECOMPRESSOR_CHARS_OUT HUFFMAN_DECOMPRESSOR_CHARS_OUT
+  #define RESTARTABLE true
+  #define SOFT_CODEC false
+  #define LIMIT_CAM_SIZE 0
+  #define LIMIT_MAX_CHARS_TO_ENCODE 0
+  #define LIMIT_PASS_ONE_SIZE HUFFMAN_PASS_ONE_SIZE
+  #define COMPRESSOR_STAGES(X) X("counter", debug_counter) \
+    X("tree-generator", debug_treeGenerator) X("encoder", debug_encoder)
+  #define NUM_COMPRESSOR_STAGES 3
+#else
+  #define COMPRESSOR DeflateCompressor
+  #define DECOMPRESSOR DeflateDecompressor
+  #define COMPRESSED_LANE BitLane
+  #define COMPRESSED_LANE_BITS 1
+  #define COMPRESSOR_CHARS_IN DEFLATE_COMPRESSOR_CHARS_IN
+  #define COMPRESSOR_LANES_OUT DEFLATE_COMPRESSOR_BITS_OUT
+  #define DECOMPRESSOR_LANES_IN DEFLATE_DECOMPRESSOR_BITS_IN
+  #define DECOMPRESSOR_CHARS_OUT DEFLATE_DECOMPRESSOR_CHARS_OUT
+  #define RESTARTABLE true
+  // the software codec only knows the Deflate format
+  #define SOFT_CODEC true
+  #define LIMIT_CAM_SIZE DEFLATE_LZ_CAM_SIZE
+  #define LIMIT_MAX_CHARS_TO_ENCODE DEFLATE_LZ_MAX_CHARS_TO_ENCODE
+  #define LIMIT_PASS_ONE_SIZE DEFLATE_HUFFMAN_PASS_ONE_SIZE
+  #define COMPRESSOR_STAGES(X) X("lz-cam", debug_lz_cam) \
+    X("lz-encoder", debug_lz_encoder) \
+    X("huffman-counter", debug_huffman_counter) \
+    X("huffman-tree-generator", debug_huffman_treeGenerator) \
+    X("huffman-encoder", debug_huffman_encoder)
+  #define NUM_COMPRESSOR_STAGES 5
 #endif
 #define VCOMPRESSOR CAT(V,COMPRESSOR)
 #define VDECOMPRESSOR CAT(V,DECOMPRESSOR)
@@ -31,23 +114,45 @@
 #ifndef TRACE_ENABLE
 #define TRACE_ENABLE false
 #endif
+// models verilated with `--trace-fst` write FST instead of VCD
+#ifndef TRACE_FST
+#define TRACE_FST false
+#endif
 #if TRACE_ENABLE
-  #include "verilated_vcd_c.h"
+  #if TRACE_FST
+    #include "verilated_fst_c.h"
+    typedef VerilatedFstC TraceFile;
+  #else
+    #include "verilated_vcd_c.h"
+    typedef VerilatedVcdC TraceFile;
+  #endif
+  // time runs on outside the trace window, so the cycles that are dumped
+  // keep their place in the run
   #define COMPRESSOR_TRACE(t) do \
-    if(compressorTraceEnable) { \
-      compressorTrace->dump(compressorContext->time()); \
-      compressorContext->timeInc(t); \
+    if(inst->compressorTraceEnable) { \
+      if(inst->compressorTraceOn) \
+        inst->compressorTrace->dump(inst->compressorContext->time()); \
+      inst->compressorContext->timeInc(t); \
     } while(false)
   #define DECOMPRESSOR_TRACE(t) do \
-    if(decompressorTraceEnable) { \
-      decompressorTrace->dump(decompressorContext->time()); \
-      decompressorContext->timeInc(t); \
+    if(inst->decompressorTraceEnable) { \
+      if(inst->decompressorTraceOn) \
+        inst->decompressorTrace->dump(inst->decompressorContext->time()); \
+      inst->decompressorContext->timeInc(t); \
     } while(false)
 #else
   #define COMPRESSOR_TRACE(t) do {} while(false)
   #define DECOMPRESSOR_TRACE(t) do {} while(false)
 #endif
 
+// models verilated with `--savable` can be checkpointed (see `--checkpoint`)
+#ifndef SAVABLE_ENABLE
+#define SAVABLE_ENABLE false
+#endif
+#if SAVABLE_ENABLE
+  #include "verilated_save.h"
+#endif
+
 
 #ifndef TIMEOUT
 #define TIMEOUT (idle >= 5000)
@@ -59,7 +164,10 @@
 #define ARG_COMPRESSOR_TRACE 3
 #define ARG_DECOMPRESSOR_TRACE 4
 
+// default size of the pages a dump is cut into (see `--page-size`)
 #define PAGE_SIZE 4096
+// results and archives hold page sizes in 32 bits, compressed bits included
+#define MAX_PAGE_SIZE (1 << 26)
 
 #define STAGE_LOAD 0
 #define STAGE_COMPRESSOR 1
@@ -68,137 +176,1361 @@
 #define NUM_STAGES 4
 #define STAGE_FINISH -1
 
+// how compressed pages are produced (see `--compress`)
+#define COMPRESS_HARDWARE 0
+#define COMPRESS_SOFTWARE 1
+// replayed from an archive of an earlier run (see `--replay`)
+#define COMPRESS_ARCHIVE 2
+
+// how decompressed pages are produced for checking (see `--verify`)
+#define VERIFY_HARDWARE 0
+#define VERIFY_SOFTWARE 1
+
+// What held a module back in a simulated cycle (see classifyCycle); the
+// CYCLE_* kinds are shared with the results file
+#define NUM_CYCLE_KINDS RESULT_CYCLE_KINDS
+static const char *cycleKindNames[NUM_CYCLE_KINDS] =
+  {"busy", "starved", "backpressured", "idle"};
+
+// The compressor's stages report their occupancy as cycle kinds, a blocked
+// stage counting as backpressured.
+#define STAGE_NAME(name, port) name,
+#define STAGE_PORT(name, port) module->port,
+static const char *compressorStageNames[NUM_COMPRESSOR_STAGES] =
+  {COMPRESSOR_STAGES(STAGE_NAME)};
+#if NUM_COMPRESSOR_STAGES > RESULT_MAX_STAGES
+#error "the results file holds at most RESULT_MAX_STAGES compressor stages"
+#endif
+
+// how modules are clocked (see `--clocking` and doStream)
+#define CLOCKING_FULL 0
+#define CLOCKING_MINIMAL 1
+
+// which cycles are dumped to the traces (see `--trace-window`)
+#define TRACE_WINDOW_ALL 0
+#define TRACE_WINDOW_DEBUG_JOB 1
+#define TRACE_WINDOW_CYCLES 2
+
+// default seconds between checkpoints (see `--checkpoint-interval`)
+#define CHECKPOINT_INTERVAL 600
+
+// default clock of the modules serving `--access-trace`, in MHz
+#define ACCESS_CLOCK 1000
+
+// how a pool hands pages to its instances (see `--pool` and dispatchPages)
+#define DISPATCH_ROUND_ROBIN 0
+#define DISPATCH_LEAST_LOADED 1
+#define DISPATCH_SIZE_AWARE 2
+
+// what is done with pages repeating one 8-byte word (see `--same-pages`)
+#define SAME_PAGES_SIMULATE 0
+#define SAME_PAGES_BYPASS 1
+// not looked for, the default
+#define SAME_PAGES_OFF 2
+// a bypassed page is stored as its word, the page size being implied
+#define SAME_PAGE_DESCRIPTOR_BITS 64
+
+// default number of strata of `--sample`, and the most there may be
+#define SAMPLE_STRATA 8
+#define MAX_SAMPLE_STRATA 64
+// two-sided 95% quantile of the normal distribution, for the intervals of
+// the sampling estimates
+#define SAMPLE_Z 1.96
+
+// latency percentiles reported for each module
+#define NUM_PERCENTILES 3
+static const int percentiles[NUM_PERCENTILES] = {50, 90, 99};
+
+// default depth of the job ring (see `--job-queue-size`)
 #define JOB_QUEUE_SIZE 10
+// A module may hold two pages at once (one being input while the previous one
+// is output), so the ring must be deeper than that to avoid aliasing.
+#define MIN_JOB_QUEUE_SIZE 3
 
 
 static size_t min(size_t a, size_t b) {return a <= b ? a : b;}
 static size_t max(size_t a, size_t b) {return a >= b ? a : b;}
 
 
+// Jobs circulate through a ring shared by the stages. A job belongs to the
+// stage named by `stage`, and only that stage may touch it. Each stage is the
+// single producer for the next one, so handing a job over is a single atomic
+// store, and the stages may run on separate threads without locks.
 struct Job {
-  int stage;
+  std::atomic<int> stage;
   int id;
+  // index of the page in the dump (see `--access-trace`)
+  long int page;
+  // stratum of the page with `--sample`, or -1
+  int stratum;
   
   uint8_t *raw;
   size_t rawLen;
   size_t rawCap;
-  uint8_t *compressed;
-  size_t compressedLen; // in bits, not bytes
-  size_t compressedCap; // in bytes
+  struct BitQueue compressed;
   uint8_t *decompressed;
   size_t decompressedLen;
   size_t decompressedCap;
   
   int compressorCycles;
   int decompressorCycles;
-  int compressorStallCycles;
-  int decompressorStallCycles;
+  // cycles while the page was in each module, by kind
+  int compressorCycleKinds[NUM_CYCLE_KINDS];
+  int decompressorCycleKinds[NUM_CYCLE_KINDS];
+  // The page's share of each module's total cycles, by kind. A cycle is
+  // charged to the page being input, or to the oldest page while the module
+  // only drains, so the shares of all pages add up to the totals.
+  int compressorShareKinds[NUM_CYCLE_KINDS];
+  int decompressorShareKinds[NUM_CYCLE_KINDS];
+  // cycles while the page was in the compressor, by kind in each stage
+  int compressorStageKinds[NUM_COMPRESSOR_STAGES][NUM_CYCLE_KINDS];
+  
+  // error from the software codec, if it was used
+  int softError;
+  // the compressor gave up on the page (see `--abort-threshold`), which is
+  // stored raw and skips the decompressor
+  bool aborted;
+  // the page repeats one 8-byte word (see `--same-pages`)
+  bool sameValue;
+  
+  // duplicate pages (see `--dedup`)
+  struct PageHash hash;
+  // an identical page was loaded before this one
+  bool duplicate;
+  // an earlier page has the same hash but other bytes, so this one is
+  // simulated and its results are not shared
+  bool collision;
+  // the results of that page are reused instead of simulating this one, and
+  // the cycle counts above are its recorded ones
+  bool reused;
+  bool reusedPass;
+  size_t reusedBits;
 };
+// what each sampled page contributes to the estimates of `--sample`
+#define SAMPLE_BITS RESULT_SAMPLE_BITS
+#define SAMPLE_C_CYCLES RESULT_SAMPLE_C_CYCLES
+#define SAMPLE_D_CYCLES RESULT_SAMPLE_D_CYCLES
+#define NUM_SAMPLE_MEASURES RESULT_SAMPLE_MEASURES
+// 64-bit, so that large dumps and long runs do not overflow
 struct Summary {
-  size_t totalSize;
-  int totalPages;
-  size_t nonzeroSize;
-  int nonzeroPages;
-  size_t compressedSize;
+  uint64_t totalSize;
+  uint64_t totalPages;
+  uint64_t nonzeroSize;
+  uint64_t nonzeroPages;
+  uint64_t compressedSize;
   
-  int passedPages;
-  int failedPages;
+  uint64_t passedPages;
+  uint64_t failedPages;
   
-  int compressorCycles;
-  int compressorStalls;
-  int decompressorCycles;
-  int decompressorStalls;
+  uint64_t compressorCycles;
+  uint64_t compressorCycleKinds[NUM_CYCLE_KINDS];
+  uint64_t decompressorCycles;
+  uint64_t decompressorCycleKinds[NUM_CYCLE_KINDS];
+  // simulated compressor cycles by kind in each stage; reused and replayed
+  // pages are not simulated and count nothing here
+  uint64_t compressorStageKinds[NUM_COMPRESSOR_STAGES][NUM_CYCLE_KINDS];
+  
+  // host time spent in the module simulations
+  uint64_t compressorHostNs;
+  uint64_t decompressorHostNs;
+  
+  uint64_t duplicatePages;
+  uint64_t reusedPages;
+  // pages whose hash matched an earlier page with other bytes
+  uint64_t collisionPages;
+  
+  // pages the compressor gave up on (see `--abort-threshold`): their raw
+  // bytes, the bits output before giving up, and an estimate of the
+  // compressor cycles that saved
+  uint64_t abortedPages;
+  uint64_t abortedSize;
+  uint64_t abortedBits;
+  uint64_t estimatedSavedCycles;
+  
+  // non-zero pages repeating one 8-byte word (see `--same-pages`): their
+  // raw bytes, their footprint (compressed, or as descriptors when bypassed)
+  // and the module cycles they take, or the fewest they would have taken
+  // when bypassed
+  uint64_t samePages;
+  uint64_t sameSize;
+  uint64_t sameBits;
+  uint64_t sameCompressorCycles;
+  uint64_t sameDecompressorCycles;
+  
+  // non-zero pages left out by `--sample`; the counts above are of the
+  // sampled ones
+  uint64_t unsampledPages;
+  uint64_t unsampledSize;
+  struct ResultStratum strata[MAX_SAMPLE_STRATA];
+  
+  // pages checked by `--compare-soft`, those whose stream differs from the
+  // software compressor's, and the bits of both streams of the checked pages
+  uint64_t comparedPages;
+  uint64_t comparedDiffering;
+  uint64_t comparedHardwareBits;
+  uint64_t comparedSoftBits;
 };
 struct Options {
   const char *dump;
   const char *report;
+  const char *results;
   const char *cTrace;
   const char *dTrace;
+  int traceWindow;
+  uint64_t traceFirst;
+  uint64_t traceLast;
   const char *debugJob;
   const char *debugRDump;
   const char *debugCDump;
   const char *debugDDump;
   long int dumpSeek;
-  long int dumpLimit;
+  // unsigned, like the sizes they are compared with
+  size_t dumpLimit;
+  size_t pageSize;
+  int workers;
+  int jobQueueSize;
+  bool stageThreads;
+  bool mmap;
+  int compress;
+  int verify;
+  int clocking;
+  bool dedup;
+  const char *checkpoint;
+  const char *resume;
+  int checkpointInterval;
+  const char *archive;
+  const char *replay;
+  const char *accessTrace;
+  int accessInstances;
+  double accessClock;
+  int pool;
+  int dispatch;
+  double sample;
+  int sampleStrata;
+  long int abortThreshold;
+  int samePages;
+  bool compareSoft;
 };
-static Options options;
 
-static VCOMPRESSOR *compressor;
-static VDECOMPRESSOR *decompressor;
-static VerilatedContext *compressorContext;
-static VerilatedContext *decompressorContext;
+// A range of dump pages owned by one instance. Other instances steal from the
+// back of the range when their own range runs dry. The bounds change only
+// under the lock, but are atomic so that thieves can peek at them without it.
+struct PageRange {
+  std::mutex lock;
+  std::atomic<long int> begin;
+  std::atomic<long int> end;
+};
+
+// One compressor/decompressor pair with its own simulation context, job queue
+// and summary. With `--workers N`, each instance runs on its own thread; with
+// `--pool K`, K instances run on one thread in lock-step.
+struct Instance {
+  int index;
+  
+  VCOMPRESSOR *compressor;
+  VDECOMPRESSOR *decompressor;
+  VerilatedContext *compressorContext;
+  VerilatedContext *decompressorContext;
 #if TRACE_ENABLE
-static VerilatedVcdC *compressorTrace;
-static VerilatedVcdC *decompressorTrace;
-static bool compressorTraceEnable = false;
-static bool decompressorTraceEnable = false;
+  TraceFile *compressorTrace;
+  TraceFile *decompressorTrace;
+  bool compressorTraceEnable;
+  bool decompressorTraceEnable;
+  // whether the current cycle of each module is in the trace window
+  bool compressorTraceOn;
+  bool decompressorTraceOn;
 #endif
+  
+  Job *jobs;
+  Summary summary;
+  PageRange pages;
+  
+  // stage progress (persists between calls to the stage functions)
+  int loadIdx;
+  int compressorIdxIn;
+  int compressorIdxOut;
+  int compressorInBufIdx;
+  int decompressorIdxIn;
+  int decompressorIdxOut;
+  int decompressorInBufIdx;
+  int finalizeIdx;
+  // cycles without progress, for the timeout of a module stepped cycle by
+  // cycle
+  int compressorIdle;
+  int decompressorIdle;
+  
+  // per-page cycle latencies of each module
+  struct ResultHistogram compressorLatency;
+  struct ResultHistogram decompressorLatency;
+  
+  // working memory of the software compressor (see `--compress software`)
+  struct SoftDeflateScratch softScratch;
+  // the software stream and LZ characters of a page, and their capacity,
+  // for `--compare-soft`
+  struct BitQueue compareStream;
+  uint8_t *compareLz[2];
+  size_t compareCap;
+};
+
+static Options options;
+
+static Instance *instances;
+// workers, or the instances of the pool
+static int instanceCount;
+// cycles of the pool, counted while any of its modules of a kind is clocked
+static uint64_t poolCompressorCycles;
+static uint64_t poolDecompressorCycles;
+// the next instance to get a page with round-robin dispatch
+static int poolTurn;
+// set once the dump has run out, after which the instances get their
+// end-of-dump markers
+static bool poolDrained;
 static FILE *dumpfile;
+static int dumpfd;
+static long int dumpSize;
+static long int dumpPages;
+// read-only mapping of the whole dump file, or NULL when reading a stream
+static uint8_t *dumpMap;
+static size_t dumpMapLen;
 static FILE *reportfile;
-static Job jobs[JOB_QUEUE_SIZE];
+// written under reportLock; large, so not on the stack
+static struct ResultWriter resultWriter;
+static bool writeResults;
+// compressed pages written (see `--archive`) under reportLock, or replayed
+static struct ArchiveWriter archiveWriter;
+static bool writeArchive;
+static struct ArchiveReader replayArchive;
+// the accesses of `--access-trace`, and the cycles of every page of the dump
+// they are served in, set by load and finalize
+static struct Access *accesses;
+static size_t accessCount;
+static struct AccessPage *accessPages;
+static std::mutex reportLock;
+static bool printHeader = true;
 static Summary summary;
 static int debugJobId;
 static bool quit;
+static struct SoftDeflateParams softParams;
+// wall time of this run, and of the runs it resumes
+static std::chrono::steady_clock::time_point runStart;
+static double priorWallTime;
+static std::chrono::steady_clock::time_point nextCheckpoint;
+// set on SIGTERM when checkpointing; the run saves a checkpoint and stops
+static volatile sig_atomic_t stopRequested;
 
-static bool doLoad();
-static bool doCompressor();
-static bool doDecompressor();
-static bool doFinalize();
+// The results of the first page with each content (see `--dedup`), shared by
+// all instances. An entry is created when the page is loaded and becomes
+// `ready` once the page is finalized. It keeps where the page's bytes are, so
+// that a page with the same hash is only taken for a copy if they match.
+struct DedupEntry {
+  // into the dump mapping, or into dedupPages for copied dumps
+  int64_t pageOffset;
+  size_t pageLen;
+  bool ready;
+  bool pass;
+  bool aborted;
+  size_t compressedBits;
+  int compressorCycles;
+  int decompressorCycles;
+  int compressorCycleKinds[NUM_CYCLE_KINDS];
+  int decompressorCycleKinds[NUM_CYCLE_KINDS];
+  int compressorShareKinds[NUM_CYCLE_KINDS];
+  int decompressorShareKinds[NUM_CYCLE_KINDS];
+  int compressorStageKinds[NUM_COMPRESSOR_STAGES][NUM_CYCLE_KINDS];
+};
+struct PageHashHasher {
+  size_t operator()(const struct PageHash &h) const {return h.lo;}
+};
+struct PageHashEqual {
+  bool operator()(const struct PageHash &a, const struct PageHash &b) const {
+    return a.lo == b.lo && a.hi == b.hi;
+  }
+};
+static std::unordered_map<struct PageHash, struct DedupEntry, PageHashHasher,
+  PageHashEqual> dedupCache;
+// the bytes of the first page with each content, when the dump is not mapped
+static std::vector<uint8_t> dedupPages;
+static std::mutex dedupLock;
+
+static bool doLoad(Instance *inst);
+static bool doCompressor(Instance *inst);
+static bool doDecompressor(Instance *inst);
+static bool doFinalize(Instance *inst);
+// one cycle of a module of the pool; false if it has no page to work on
+static bool stepCompressor(Instance *inst);
+static bool stepDecompressor(Instance *inst);
 
-static bool isFinished() {
-  for(int i = 0; i < JOB_QUEUE_SIZE; i++) {
-    if(jobs[i].stage != STAGE_FINISH && jobs[i].stage != STAGE_LOAD)
+static bool isFinished(Instance *inst) {
+  for(int i = 0; i < options.jobQueueSize; i++) {
+    if(inst->jobs[i].stage != STAGE_FINISH &&
+        inst->jobs[i].stage != STAGE_LOAD)
       return false;
   }
-  for(int i = 0; i < JOB_QUEUE_SIZE; i++) {
-    if(jobs[i].stage == STAGE_FINISH)
+  for(int i = 0; i < options.jobQueueSize; i++) {
+    if(inst->jobs[i].stage == STAGE_FINISH)
       return true;
   }
   return false;
 }
 
+static void cleanupInstance(Instance *inst) {
+  inst->compressor->final();
+  inst->decompressor->final();
+  
+  #if TRACE_ENABLE
+  if(inst->compressorTraceEnable) {
+    inst->compressorTrace->close();
+  }
+  if(inst->decompressorTraceEnable) {
+    inst->decompressorTrace->close();
+  }
+  #endif
+  
+  delete inst->compressor;
+  delete inst->decompressor;
+  for(int i = 0; i < options.jobQueueSize; i++)
+    bq_free(&inst->jobs[i].compressed);
+  delete[] inst->jobs;
+  sd_freeScratch(&inst->softScratch);
+  bq_free(&inst->compareStream);
+  free(inst->compareLz[0]);
+  free(inst->compareLz[1]);
+  
+  #if TRACE_ENABLE
+  if(inst->compressorTraceEnable) {
+    delete inst->compressorContext;
+  }
+  if(inst->decompressorTraceEnable) {
+    delete inst->decompressorContext;
+  }
+  #endif
+}
+
 static void cleanup() {
-  compressor->final();
-  decompressor->final();
+  for(int i = 0; i < instanceCount; i++)
+    cleanupInstance(&instances[i]);
   
+  if(dumpMap != NULL)
+    munmap(dumpMap, dumpMapLen);
+  if(options.compress == COMPRESS_ARCHIVE)
+    ar_close(&replayArchive);
+  free(accesses);
+  free(accessPages);
   if(dumpfile != stdin)
   fclose(dumpfile);
   if(reportfile != stdout)
   fclose(reportfile);
+}
+
+// called when a simulation times out; keeps the report and traces usable
+static void abortInstance(Instance *inst) {
+  if(options.stageThreads) {
+    // the other stages are still using the models, so only save the report
+    std::lock_guard<std::mutex> guard(reportLock);
+    fflush(reportfile);
+    return;
+  }
+  if(options.workers == 1) {
+    cleanup();
+    return;
+  }
+  cleanupInstance(inst);
+  std::lock_guard<std::mutex> guard(reportLock);
+  fflush(reportfile);
+}
+
+static void addSummary(Summary *sum, const Summary *part) {
+  sum->totalSize += part->totalSize;
+  sum->totalPages += part->totalPages;
+  sum->nonzeroSize += part->nonzeroSize;
+  sum->nonzeroPages += part->nonzeroPages;
+  sum->compressedSize += part->compressedSize;
+  sum->passedPages += part->passedPages;
+  sum->failedPages += part->failedPages;
+  sum->compressorCycles += part->compressorCycles;
+  for(int k = 0; k < NUM_CYCLE_KINDS; k++)
+    sum->compressorCycleKinds[k] += part->compressorCycleKinds[k];
+  sum->decompressorCycles += part->decompressorCycles;
+  for(int k = 0; k < NUM_CYCLE_KINDS; k++)
+    sum->decompressorCycleKinds[k] += part->decompressorCycleKinds[k];
+  for(int s = 0; s < NUM_COMPRESSOR_STAGES; s++)
+    for(int k = 0; k < NUM_CYCLE_KINDS; k++)
+      sum->compressorStageKinds[s][k] += part->compressorStageKinds[s][k];
+  sum->compressorHostNs += part->compressorHostNs;
+  sum->decompressorHostNs += part->decompressorHostNs;
+  sum->duplicatePages += part->duplicatePages;
+  sum->reusedPages += part->reusedPages;
+  sum->collisionPages += part->collisionPages;
+  sum->abortedPages += part->abortedPages;
+  sum->abortedSize += part->abortedSize;
+  sum->abortedBits += part->abortedBits;
+  sum->estimatedSavedCycles += part->estimatedSavedCycles;
+  sum->samePages += part->samePages;
+  sum->sameSize += part->sameSize;
+  sum->sameBits += part->sameBits;
+  sum->sameCompressorCycles += part->sameCompressorCycles;
+  sum->sameDecompressorCycles += part->sameDecompressorCycles;
+  sum->unsampledPages += part->unsampledPages;
+  sum->unsampledSize += part->unsampledSize;
+  sum->comparedPages += part->comparedPages;
+  sum->comparedDiffering += part->comparedDiffering;
+  sum->comparedHardwareBits += part->comparedHardwareBits;
+  sum->comparedSoftBits += part->comparedSoftBits;
+  for(int h = 0; h < MAX_SAMPLE_STRATA; h++) {
+    struct ResultStratum *s = &sum->strata[h];
+    const struct ResultStratum *p = &part->strata[h];
+    s->pages += p->pages;
+    s->sampled += p->sampled;
+    for(int m = 0; m < NUM_SAMPLE_MEASURES; m++) {
+      s->sum[m] += p->sum[m];
+      s->sumSq[m] += p->sumSq[m];
+    }
+  }
+}
+
+// the latencies of all instances for one module
+static void mergeLatency(struct ResultHistogram *all,
+    struct ResultHistogram Instance::*hist) {
+  memset(all, 0, sizeof(*all));
+  for(int i = 0; i < instanceCount; i++)
+    rh_merge(all, &(instances[i].*hist));
+}
+
+// Print the latency percentiles of one module. `m` is the "C" or "D" prefix
+// of the summary keys.
+static void printLatency(const char *m, const struct ResultHistogram *hist) {
+  for(int p = 0; p < NUM_PERCENTILES; p++)
+    fprintf(reportfile, "%s-latency p%d (cycles): %lu\n", m, percentiles[p],
+      rh_percentile(hist, percentiles[p]));
+  fprintf(reportfile, "%s-latency max (cycles): %lu\n", m, hist->max);
+}
+
+// Serve the accesses of `--access-trace` with the cycles of the simulated
+// pages, and report the delays they see.
+static void printAccessTrace() {
+  static const char *kindNames[ACCESS_KINDS] = {"read", "write"};
+  // large, so not on the stack
+  static struct AccessStats stats[ACCESS_KINDS];
+  uint64_t unknown, span;
+  at_simulate(accesses, accessCount, accessPages, dumpPages,
+    options.accessInstances, options.accessClock, stats, &unknown, &span);
   
-  #if TRACE_ENABLE
-  if(compressorTraceEnable) {
-    compressorTrace->close();
+  fprintf(reportfile, "\n***** ACCESS TRACE *****\n");
+  fprintf(reportfile, "access trace: %s\n", options.accessTrace);
+  fprintf(reportfile, "instances: %d\n", options.accessInstances);
+  fprintf(reportfile, "clock (MHz): %f\n", options.accessClock);
+  fprintf(reportfile, "accesses: %lu\n", accessCount);
+  // pages outside the dump, or past `--dump-limit`
+  fprintf(reportfile, "unknown pages (accesses): %lu\n", unknown);
+  fprintf(reportfile, "span (cycles): %lu\n", span);
+  for(int k = 0; k < ACCESS_KINDS; k++) {
+    const char *m = kindNames[k];
+    struct AccessStats *s = &stats[k];
+    fprintf(reportfile, "%s (accesses): %lu\n", m, s->served);
+    fprintf(reportfile, "%s zero pages (accesses): %lu\n", m, s->zero);
+    if(options.samePages == SAME_PAGES_BYPASS)
+      fprintf(reportfile, "%s same-value pages (accesses): %lu\n", m,
+        s->same);
+    for(int p = 0; p < NUM_PERCENTILES; p++)
+      fprintf(reportfile, "%s-queueing p%d (cycles): %lu\n", m,
+        percentiles[p], rh_percentile(&s->queueing, percentiles[p]));
+    fprintf(reportfile, "%s-queueing max (cycles): %lu\n", m,
+      s->queueing.max);
+    for(int p = 0; p < NUM_PERCENTILES; p++)
+      fprintf(reportfile, "%s-latency p%d (cycles): %lu\n", m,
+        percentiles[p], rh_percentile(&s->latency, percentiles[p]));
+    fprintf(reportfile, "%s-latency max (cycles): %lu\n", m, s->latency.max);
+    // busy share of the modules of this kind over the span
+    fprintf(reportfile, "%s-utilization: %f\n", m,
+      (double)s->busy / ((double)span * options.accessInstances));
   }
-  if(decompressorTraceEnable) {
-    decompressorTrace->close();
+}
+
+// Report the throughput of the pool over its lock-step cycles, and how the
+// dispatch policy spread the pages over the instances.
+static void printPool() {
+  static const char *dispatchNames[] =
+    {"round-robin", "least-loaded", "size-aware"};
+  fprintf(reportfile, "\n***** POOL *****\n");
+  fprintf(reportfile, "instances: %d\n", instanceCount);
+  fprintf(reportfile, "dispatch: %s\n", dispatchNames[options.dispatch]);
+  fprintf(reportfile, "pool C-cycles: %lu\n", poolCompressorCycles);
+  fprintf(reportfile, "pool C-throughput (B/c): %f\n",
+    (double)summary.nonzeroSize / poolCompressorCycles);
+  fprintf(reportfile, "pool D-cycles: %lu\n", poolDecompressorCycles);
+  fprintf(reportfile, "pool D-throughput (B/c): %f\n",
+    (double)summary.nonzeroSize / poolDecompressorCycles);
+  for(int i = 0; i < instanceCount; i++) {
+    Summary *s = &instances[i].summary;
+    fprintf(reportfile, "instance %d (pages): %lu\n", i, s->nonzeroPages);
+    // busy share of the pool's cycles
+    fprintf(reportfile, "instance %d C-utilization: %f\n", i,
+      (double)s->compressorCycleKinds[CYCLE_BUSY] / poolCompressorCycles);
+    fprintf(reportfile, "instance %d D-utilization: %f\n", i,
+      (double)s->decompressorCycleKinds[CYCLE_BUSY] / poolDecompressorCycles);
   }
-  #endif
+}
+
+// Estimate the total of a measure over all non-zero pages from the sampled
+// ones (stratified expansion estimator), and the variance of the estimate.
+static void estimateTotal(const Summary *sum, int m, double *total,
+    double *variance) {
+  *total = 0;
+  *variance = 0;
+  for(int h = 0; h < options.sampleStrata; h++) {
+    const struct ResultStratum *s = &sum->strata[h];
+    if(!s->sampled)
+      continue;
+    double n = s->sampled;
+    double pages = s->pages;
+    double mean = s->sum[m] / n;
+    *total += pages * mean;
+    if(n > 1) {
+      double var = (s->sumSq[m] - n * mean * mean) / (n - 1);
+      if(var > 0)
+        *variance += pages * pages * (1 - n / pages) * var / n;
+    }
+  }
+}
+
+// Extrapolate the pages sampled by `--sample` to all non-zero pages, with
+// 95% confidence intervals. The bytes of every page are known, so the ratio
+// and throughputs are those bytes over the estimated bits and cycles.
+static void printSampling() {
+  static const char *totalNames[NUM_SAMPLE_MEASURES] =
+    {"compressed (bits)", "C-cycles", "D-cycles"};
+  static const char *rateNames[NUM_SAMPLE_MEASURES] =
+    {"compression ratio", "C-throughput (B/c)", "D-throughput (B/c)"};
+  static const double rateScales[NUM_SAMPLE_MEASURES] = {8, 1, 1};
+  double bytes = summary.nonzeroSize + summary.unsampledSize;
+  fprintf(reportfile, "\n***** SAMPLING *****\n");
+  fprintf(reportfile, "sample fraction: %f\n", options.sample);
+  fprintf(reportfile, "strata: %d\n", options.sampleStrata);
+  fprintf(reportfile, "sampled (pages): %lu\n", summary.nonzeroPages);
+  fprintf(reportfile, "unsampled (pages): %lu\n", summary.unsampledPages);
+  fprintf(reportfile, "unsampled (bytes): %lu\n", summary.unsampledSize);
+  // The first two pages of each stratum are always simulated, which on a
+  // short dump (or chunk of one) puts a floor on the fraction.
+  double sampled = (double)summary.nonzeroPages /
+    (summary.nonzeroPages + summary.unsampledPages);
+  fprintf(reportfile, "sampled fraction: %f\n", sampled);
+  if(sampled > 2 * options.sample)
+    fprintf(stderr, "warning: simulated %f of the non-zero pages for "
+      "--sample %f; each stratum's first two pages are always simulated, so "
+      "short dumps or chunks sample more\n", sampled, options.sample);
+  for(int m = 0; m < NUM_SAMPLE_MEASURES; m++) {
+    double total, variance;
+    estimateTotal(&summary, m, &total, &variance);
+    double margin = SAMPLE_Z * sqrt(variance);
+    double scaled = rateScales[m] * bytes;
+    fprintf(reportfile, "estimated %s: %f\n", totalNames[m], total);
+    fprintf(reportfile, "estimated %s: %f\n", rateNames[m], scaled / total);
+    // the upper end of the total is the lower end of the rate
+    fprintf(reportfile, "%s CI low: %f\n", rateNames[m],
+      scaled / (total + margin));
+    fprintf(reportfile, "%s CI high: %f\n", rateNames[m],
+      total > margin ? scaled / (total - margin) : INFINITY);
+  }
+  for(int h = 0; h < options.sampleStrata; h++) {
+    fprintf(reportfile, "stratum %d (pages): %lu\n", h,
+      summary.strata[h].pages);
+    fprintf(reportfile, "stratum %d sampled (pages): %lu\n", h,
+      summary.strata[h].sampled);
+  }
+}
+
+// counters of the results file, in RESULT_* order
+static void resultCounters(const Summary *sum,
+    uint64_t counters[RESULT_MAX_COUNTERS]) {
+  counters[RESULT_TOTAL_SIZE] = sum->totalSize;
+  counters[RESULT_TOTAL_PAGES] = sum->totalPages;
+  counters[RESULT_NONZERO_SIZE] = sum->nonzeroSize;
+  counters[RESULT_NONZERO_PAGES] = sum->nonzeroPages;
+  counters[RESULT_COMPRESSED_SIZE] = sum->compressedSize;
+  counters[RESULT_PASSED_PAGES] = sum->passedPages;
+  counters[RESULT_FAILED_PAGES] = sum->failedPages;
+  counters[RESULT_COMPRESSOR_CYCLES] = sum->compressorCycles;
+  counters[RESULT_DECOMPRESSOR_CYCLES] = sum->decompressorCycles;
+  for(int k = 0; k < NUM_CYCLE_KINDS; k++) {
+    counters[RESULT_COMPRESSOR_KINDS + k] = sum->compressorCycleKinds[k];
+    counters[RESULT_DECOMPRESSOR_KINDS + k] = sum->decompressorCycleKinds[k];
+  }
+  counters[RESULT_COMPRESSOR_HOST_NS] = sum->compressorHostNs;
+  counters[RESULT_DECOMPRESSOR_HOST_NS] = sum->decompressorHostNs;
+  counters[RESULT_DUPLICATE_PAGES] = sum->duplicatePages;
+  counters[RESULT_REUSED_PAGES] = sum->reusedPages;
+  counters[RESULT_ABORTED_PAGES] = sum->abortedPages;
+  counters[RESULT_ABORTED_SIZE] = sum->abortedSize;
+  counters[RESULT_ABORTED_BITS] = sum->abortedBits;
+  counters[RESULT_ESTIMATED_SAVED_CYCLES] = sum->estimatedSavedCycles;
+  counters[RESULT_SAME_PAGES] = sum->samePages;
+  counters[RESULT_SAME_SIZE] = sum->sameSize;
+  counters[RESULT_SAME_BITS] = sum->sameBits;
+  counters[RESULT_SAME_COMPRESSOR_CYCLES] = sum->sameCompressorCycles;
+  counters[RESULT_SAME_DECOMPRESSOR_CYCLES] = sum->sameDecompressorCycles;
+  counters[RESULT_UNSAMPLED_PAGES] = sum->unsampledPages;
+  counters[RESULT_UNSAMPLED_SIZE] = sum->unsampledSize;
+  for(int s = 0; s < NUM_COMPRESSOR_STAGES; s++)
+    for(int k = 0; k < NUM_CYCLE_KINDS; k++)
+      counters[RESULT_STAGE_KINDS(s) + k] = sum->compressorStageKinds[s][k];
+}
+
+static void initInstance(Instance *inst, int index, int argc,
+    const char **argv) {
+  inst->index = index;
   
-  delete compressor;
-  delete decompressor;
+  inst->compressorContext = new VerilatedContext;
+  inst->decompressorContext = new VerilatedContext;
+  inst->compressorContext->commandArgs(argc, argv);
+  inst->decompressorContext->commandArgs(argc, argv);
+  inst->compressor =
+    new VCOMPRESSOR{inst->compressorContext, "TOP_COMPRESSOR"};
+  inst->decompressor =
+    new VDECOMPRESSOR{inst->decompressorContext, "TOP_DECOMPRESSOR"};
   
   #if TRACE_ENABLE
-  if(compressorTraceEnable) {
-    delete compressorContext;
+  // each instance writes its own trace, suffixed with the instance index
+  char traceName[PATH_MAX];
+  inst->compressorTraceEnable = !!strcmp(options.cTrace, "-");
+  inst->compressorTraceOn = options.traceWindow == TRACE_WINDOW_ALL;
+  if(inst->compressorTraceEnable) {
+    if(instanceCount > 1)
+      snprintf(traceName, sizeof(traceName), "%s.%d", options.cTrace, index);
+    else
+      snprintf(traceName, sizeof(traceName), "%s", options.cTrace);
+    inst->compressorContext->traceEverOn(true);
+    inst->compressorTrace = new TraceFile;
+    inst->compressor->trace(inst->compressorTrace, 99);
+    inst->compressorTrace->open(traceName);
   }
-  if(decompressorTraceEnable) {
-    delete decompressorContext;
+  
+  inst->decompressorTraceEnable = !!strcmp(options.dTrace, "-");
+  inst->decompressorTraceOn = options.traceWindow == TRACE_WINDOW_ALL;
+  if(inst->decompressorTraceEnable) {
+    if(instanceCount > 1)
+      snprintf(traceName, sizeof(traceName), "%s.%d", options.dTrace, index);
+    else
+      snprintf(traceName, sizeof(traceName), "%s", options.dTrace);
+    inst->decompressorContext->traceEverOn(true);
+    inst->decompressorTrace = new TraceFile;
+    inst->decompressor->trace(inst->decompressorTrace, 99);
+    inst->decompressorTrace->open(traceName);
   }
   #endif
+  
+  inst->jobs = new Job[options.jobQueueSize];
+  for(int i = 0; i < options.jobQueueSize; i++) {
+    inst->jobs[i].stage = 0;
+    inst->jobs[i].raw = NULL;
+    inst->jobs[i].rawLen = 0;
+    inst->jobs[i].rawCap = 0;
+    bq_init(&inst->jobs[i].compressed);
+    inst->jobs[i].decompressed = NULL;
+    inst->jobs[i].decompressedLen = 0;
+    inst->jobs[i].decompressedCap = 0;
+    inst->jobs[i].compressorCycles = 0;
+    inst->jobs[i].decompressorCycles = 0;
+    memset(inst->jobs[i].compressorCycleKinds, 0,
+      sizeof(inst->jobs[i].compressorCycleKinds));
+    memset(inst->jobs[i].decompressorCycleKinds, 0,
+      sizeof(inst->jobs[i].decompressorCycleKinds));
+    memset(inst->jobs[i].compressorShareKinds, 0,
+      sizeof(inst->jobs[i].compressorShareKinds));
+    memset(inst->jobs[i].decompressorShareKinds, 0,
+      sizeof(inst->jobs[i].decompressorShareKinds));
+    memset(inst->jobs[i].compressorStageKinds, 0,
+      sizeof(inst->jobs[i].compressorStageKinds));
+    inst->jobs[i].stratum = -1;
+    inst->jobs[i].softError = SD_OK;
+    inst->jobs[i].aborted = false;
+    inst->jobs[i].sameValue = false;
+    inst->jobs[i].duplicate = false;
+    inst->jobs[i].collision = false;
+    inst->jobs[i].reused = false;
+  }
+  sd_initScratch(&inst->softScratch);
+  bq_init(&inst->compareStream);
+  inst->compareLz[0] = NULL;
+  inst->compareLz[1] = NULL;
+  inst->compareCap = 0;
+  
+  memset(&inst->summary, 0, sizeof(inst->summary));
+  
+  // split the dump evenly between workers; stealing balances the rest. The
+  // instances of a pool take all pages from the first one (see claimPage).
+  inst->pages.begin = index < options.workers ?
+    dumpPages * index / options.workers : 0;
+  inst->pages.end = index < options.workers ?
+    dumpPages * (index + 1) / options.workers : 0;
+  
+  inst->loadIdx = 0;
+  inst->compressorIdxIn = 0;
+  inst->compressorIdxOut = 0;
+  inst->compressorInBufIdx = 0;
+  inst->decompressorIdxIn = 0;
+  inst->decompressorIdxOut = 0;
+  inst->decompressorInBufIdx = 0;
+  inst->finalizeIdx = 0;
+  inst->compressorIdle = 0;
+  inst->decompressorIdle = 0;
+  memset(&inst->compressorLatency, 0, sizeof(inst->compressorLatency));
+  memset(&inst->decompressorLatency, 0, sizeof(inst->decompressorLatency));
+  
+  // 0 when pages are never aborted
+  inst->compressor->abort_limit = options.abortThreshold;
+  
+  // assert reset on rising edge to initialize module state
+  inst->compressor->reset = 1;
+  inst->compressor->clock = 0;
+  inst->compressor->eval();
+  COMPRESSOR_TRACE(400);
+  inst->compressor->clock = 1;
+  inst->compressor->eval();
+  COMPRESSOR_TRACE(50);
+  inst->compressor->reset = 0;
+  
+  inst->decompressor->reset = 1;
+  inst->decompressor->clock = 0;
+  inst->decompressor->eval();
+  DECOMPRESSOR_TRACE(400);
+  inst->decompressor->clock = 1;
+  inst->decompressor->eval();
+  DECOMPRESSOR_TRACE(50);
+  inst->decompressor->reset = 0;
+}
+
+#if SAVABLE_ENABLE
+// A checkpoint (`--checkpoint`, `--resume`) holds everything a run needs to
+// go on: the state of both models, the job ring with the pages in flight, the
+// position in the dump, the summary and latencies so far, the dedup cache,
+// and how much of the report, results and archive files was written.
+// Checkpoints are taken between rounds of the stages, so they need a single
+// instance without stage threads.
+#define CHECKPOINT_MAGIC "DFCHKPNT"
+#define CHECKPOINT_VERSION 11
+
+// what a run must agree on with the checkpoint it resumes from
+struct CheckpointHeader {
+  char magic[8];
+  uint32_t version;
+  int32_t stream;
+  int32_t jobQueueSize;
+  int32_t compress;
+  int32_t verify;
+  int32_t dedup;
+  int32_t mapped;
+  int32_t archive;
+  int32_t access;
+  int32_t sampleStrata;
+  int32_t samePages;
+  int32_t compareSoft;
+  int64_t pageSize;
+  int64_t dumpSeek;
+  int64_t dumpSize;
+  int64_t abortThreshold;
+  double sample;
+};
+
+static void checkpointHeader(struct CheckpointHeader *header) {
+  // zeroed padding, so headers compare with memcmp
+  memset(header, 0, sizeof(*header));
+  memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+  header->version = CHECKPOINT_VERSION;
+  header->stream = STREAM;
+  header->jobQueueSize = options.jobQueueSize;
+  header->compress = options.compress;
+  header->verify = options.verify;
+  header->dedup = options.dedup;
+  header->mapped = dumpMap != NULL;
+  header->archive = writeArchive;
+  header->access = accessPages != NULL;
+  header->sampleStrata = options.sampleStrata;
+  header->samePages = options.samePages;
+  header->compareSoft = options.compareSoft;
+  header->pageSize = options.pageSize;
+  header->dumpSeek = options.dumpSeek;
+  header->dumpSize = dumpSize;
+  header->abortThreshold = options.abortThreshold;
+  header->sample = options.sample;
+}
+
+template<class T>
+static void saveValue(VerilatedSerialize &os, const T &value) {
+  os.write(&value, sizeof(value));
+}
+
+template<class T>
+static void loadValue(VerilatedDeserialize &is, T &value) {
+  is.read(&value, sizeof(value));
+}
+
+static void saveJob(VerilatedSerialize &os, Job *job) {
+  int stage = job->stage;
+  saveValue(os, stage);
+  saveValue(os, job->id);
+  saveValue(os, job->page);
+  saveValue(os, job->stratum);
+  
+  // pages in the mapping are kept by offset, copied pages by content
+  int64_t rawOffset = dumpMap != NULL && job->raw != NULL ?
+    job->raw - dumpMap : -1;
+  saveValue(os, rawOffset);
+  saveValue(os, job->rawLen);
+  if(dumpMap == NULL && job->rawLen)
+    os.write(job->raw, job->rawLen);
+  
+  size_t bits = bq_size(&job->compressed);
+  saveValue(os, bits);
+  if(bits) {
+    uint8_t *buf = (uint8_t*)malloc((bits + 7) / 8);
+    assert(buf != NULL);
+    bq_copyOut(&job->compressed, buf);
+    os.write(buf, (bits + 7) / 8);
+    free(buf);
+  }
+  saveValue(os, job->decompressedLen);
+  if(job->decompressedLen)
+    os.write(job->decompressed, job->decompressedLen);
+  
+  saveValue(os, job->compressorCycles);
+  saveValue(os, job->decompressorCycles);
+  saveValue(os, job->compressorCycleKinds);
+  saveValue(os, job->decompressorCycleKinds);
+  saveValue(os, job->compressorShareKinds);
+  saveValue(os, job->decompressorShareKinds);
+  saveValue(os, job->compressorStageKinds);
+  saveValue(os, job->softError);
+  saveValue(os, job->aborted);
+  saveValue(os, job->sameValue);
+  saveValue(os, job->hash);
+  saveValue(os, job->duplicate);
+  saveValue(os, job->collision);
+  saveValue(os, job->reused);
+  saveValue(os, job->reusedPass);
+  saveValue(os, job->reusedBits);
+}
+
+static void loadJob(VerilatedDeserialize &is, Job *job) {
+  int stage;
+  loadValue(is, stage);
+  loadValue(is, job->id);
+  loadValue(is, job->page);
+  loadValue(is, job->stratum);
+  
+  int64_t rawOffset;
+  loadValue(is, rawOffset);
+  loadValue(is, job->rawLen);
+  if(dumpMap != NULL) {
+    job->raw = rawOffset >= 0 ? dumpMap + rawOffset : NULL;
+  }
+  else {
+    if(job->raw == NULL) {
+      job->raw = (uint8_t*)malloc(options.pageSize);
+      assert(job->raw != NULL);
+      job->rawCap = options.pageSize;
+    }
+    is.read(job->raw, job->rawLen);
+  }
+  
+  size_t bits;
+  loadValue(is, bits);
+  bq_clear(&job->compressed);
+  if(bits) {
+    uint8_t *buf = (uint8_t*)malloc((bits + 7) / 8);
+    assert(buf != NULL);
+    is.read(buf, (bits + 7) / 8);
+    char err = bq_copyIn(&job->compressed, buf, bits);
+    assert(!err);
+    free(buf);
+  }
+  loadValue(is, job->decompressedLen);
+  if(job->decompressedLen > job->decompressedCap) {
+    job->decompressed = (uint8_t*)realloc(job->decompressed,
+      job->decompressedLen);
+    assert(job->decompressed != NULL);
+    job->decompressedCap = job->decompressedLen;
+  }
+  if(job->decompressedLen)
+    is.read(job->decompressed, job->decompressedLen);
+  
+  loadValue(is, job->compressorCycles);
+  loadValue(is, job->decompressorCycles);
+  loadValue(is, job->compressorCycleKinds);
+  loadValue(is, job->decompressorCycleKinds);
+  loadValue(is, job->compressorShareKinds);
+  loadValue(is, job->decompressorShareKinds);
+  loadValue(is, job->compressorStageKinds);
+  loadValue(is, job->softError);
+  loadValue(is, job->aborted);
+  loadValue(is, job->sameValue);
+  loadValue(is, job->hash);
+  loadValue(is, job->duplicate);
+  loadValue(is, job->collision);
+  loadValue(is, job->reused);
+  loadValue(is, job->reusedPass);
+  loadValue(is, job->reusedBits);
+  job->stage = stage;
+}
+
+// Write a checkpoint of the only instance. It is written next to the
+// checkpoint file and renamed over it, so an interrupted save keeps the last
+// one.
+static bool saveCheckpoint(Instance *inst) {
+  char tmpName[PATH_MAX];
+  snprintf(tmpName, sizeof(tmpName), "%s.tmp", options.checkpoint);
+  VerilatedSave os;
+  os.open(tmpName);
+  if(!os.isOpen()) {
+    fprintf(stderr, "error: cannot write %s\n", tmpName);
+    return false;
+  }
+  
+  struct CheckpointHeader header;
+  checkpointHeader(&header);
+  saveValue(os, header);
+  std::chrono::duration<double> wallTime =
+    std::chrono::steady_clock::now() - runStart;
+  saveValue(os, priorWallTime + wallTime.count());
+  
+  // the report and results are resumed from what is written so far
+  {
+    std::lock_guard<std::mutex> guard(reportLock);
+    fflush(reportfile);
+    int64_t reportOffset = ftell(reportfile);
+    int64_t resultsOffset = writeResults ? rw_sync(&resultWriter) : -1;
+    int64_t archiveOffset = writeArchive ? aw_sync(&archiveWriter) : -1;
+    saveValue(os, reportOffset);
+    saveValue(os, resultsOffset);
+    saveValue(os, printHeader);
+    saveValue(os, archiveOffset);
+    if(writeArchive) {
+      uint64_t archived = archiveWriter.count;
+      saveValue(os, archived);
+      os.write(archiveWriter.pages, sizeof(struct ArchivePage) * archived);
+    }
+  }
+  
+  int64_t dumpOffset = dumpMap == NULL ? ftell(dumpfile) : -1;
+  saveValue(os, dumpOffset);
+  long int begin = inst->pages.begin, end = inst->pages.end;
+  saveValue(os, begin);
+  saveValue(os, end);
+  
+  saveValue(os, inst->summary);
+  saveValue(os, inst->compressorLatency);
+  saveValue(os, inst->decompressorLatency);
+  saveValue(os, inst->loadIdx);
+  saveValue(os, inst->compressorIdxIn);
+  saveValue(os, inst->compressorIdxOut);
+  saveValue(os, inst->compressorInBufIdx);
+  saveValue(os, inst->decompressorIdxIn);
+  saveValue(os, inst->decompressorIdxOut);
+  saveValue(os, inst->decompressorInBufIdx);
+  saveValue(os, inst->finalizeIdx);
+  for(int i = 0; i < options.jobQueueSize; i++)
+    saveJob(os, &inst->jobs[i]);
+  if(accessPages != NULL)
+    os.write(accessPages, sizeof(struct AccessPage) * dumpPages);
+  
+  {
+    std::lock_guard<std::mutex> guard(dedupLock);
+    uint64_t entries = dedupCache.size();
+    saveValue(os, entries);
+    for(auto &entry : dedupCache) {
+      saveValue(os, entry.first);
+      saveValue(os, entry.second);
+    }
+    uint64_t pageBytes = dedupPages.size();
+    saveValue(os, pageBytes);
+    if(pageBytes)
+      os.write(dedupPages.data(), pageBytes);
+  }
+  
+  saveValue(os, inst->compressorContext->time());
+  saveValue(os, inst->decompressorContext->time());
+  os << *inst->compressor;
+  os << *inst->decompressor;
+  os.close();
+  
+  if(rename(tmpName, options.checkpoint)) {
+    fprintf(stderr, "error: cannot write %s\n", options.checkpoint);
+    return false;
+  }
+  return true;
+}
+
+// Continue the only instance from a checkpoint. The report must already be
+// open for update; the results and archive files are reopened here.
+static bool restoreCheckpoint(Instance *inst) {
+  VerilatedRestore is;
+  is.open(options.resume);
+  if(!is.isOpen()) {
+    fprintf(stderr, "error: cannot read %s\n", options.resume);
+    return false;
+  }
+  
+  struct CheckpointHeader header, expected;
+  checkpointHeader(&expected);
+  loadValue(is, header);
+  if(memcmp(&header, &expected, sizeof(header))) {
+    fprintf(stderr, "error: %s is not a checkpoint of this harness, dump "
+      "and options\n", options.resume);
+    return false;
+  }
+  loadValue(is, priorWallTime);
+  
+  // drop what was written after the checkpoint
+  int64_t reportOffset, resultsOffset;
+  loadValue(is, reportOffset);
+  loadValue(is, resultsOffset);
+  loadValue(is, printHeader);
+  if(reportOffset >= 0 && reportfile != stdout) {
+    if(ftruncate(fileno(reportfile), reportOffset) ||
+        fseek(reportfile, reportOffset, SEEK_SET)) {
+      fprintf(stderr, "error: cannot resume %s\n", options.report);
+      return false;
+    }
+  }
+  if(writeResults) {
+    if(resultsOffset < 0 ||
+        !rw_resume(&resultWriter, options.results, resultsOffset,
+          NUM_COMPRESSOR_STAGES)) {
+      fprintf(stderr, "error: cannot resume %s\n", options.results);
+      return false;
+    }
+  }
+  int64_t archiveOffset;
+  loadValue(is, archiveOffset);
+  if(writeArchive) {
+    uint64_t archived;
+    loadValue(is, archived);
+    if(!aw_resume(&archiveWriter, options.archive, archiveOffset, archived)) {
+      fprintf(stderr, "error: cannot resume %s\n", options.archive);
+      return false;
+    }
+    is.read(archiveWriter.pages, sizeof(struct ArchivePage) * archived);
+  }
+  
+  int64_t dumpOffset;
+  loadValue(is, dumpOffset);
+  if(dumpMap == NULL)
+    fseek(dumpfile, dumpOffset, SEEK_SET);
+  long int begin, end;
+  loadValue(is, begin);
+  loadValue(is, end);
+  inst->pages.begin = begin;
+  inst->pages.end = end;
+  
+  loadValue(is, inst->summary);
+  loadValue(is, inst->compressorLatency);
+  loadValue(is, inst->decompressorLatency);
+  loadValue(is, inst->loadIdx);
+  loadValue(is, inst->compressorIdxIn);
+  loadValue(is, inst->compressorIdxOut);
+  loadValue(is, inst->compressorInBufIdx);
+  loadValue(is, inst->decompressorIdxIn);
+  loadValue(is, inst->decompressorIdxOut);
+  loadValue(is, inst->decompressorInBufIdx);
+  loadValue(is, inst->finalizeIdx);
+  for(int i = 0; i < options.jobQueueSize; i++)
+    loadJob(is, &inst->jobs[i]);
+  if(accessPages != NULL)
+    is.read(accessPages, sizeof(struct AccessPage) * dumpPages);
+  
+  uint64_t entries;
+  loadValue(is, entries);
+  for(uint64_t i = 0; i < entries; i++) {
+    struct PageHash hash;
+    loadValue(is, hash);
+    loadValue(is, dedupCache[hash]);
+  }
+  uint64_t pageBytes;
+  loadValue(is, pageBytes);
+  dedupPages.resize(pageBytes);
+  if(pageBytes)
+    is.read(dedupPages.data(), pageBytes);
+  
+  uint64_t time;
+  loadValue(is, time);
+  inst->compressorContext->time(time);
+  loadValue(is, time);
+  inst->decompressorContext->time(time);
+  is >> *inst->compressor;
+  is >> *inst->decompressor;
+  is.close();
+  return true;
+}
+#endif
+
+// Run one stage on its own thread until the end-of-dump marker reaches the
+// stage's output side. The stage function returns false while its input is
+// not ready; simulated time does not advance in that case.
+static void runStage(Instance *inst, bool (*doStage)(Instance*),
+    const int *outIdx) {
+  while(!quit && inst->jobs[*outIdx].stage != STAGE_FINISH) {
+    if(!doStage(inst))
+      std::this_thread::yield();
+  }
+}
+
+static void runInstance(Instance *inst) {
+  if(options.stageThreads) {
+    std::thread load(runStage, inst, doLoad, &inst->loadIdx);
+    std::thread compress(runStage, inst, doCompressor,
+      &inst->compressorIdxOut);
+    std::thread decompress(runStage, inst, doDecompressor,
+      &inst->decompressorIdxOut);
+    runStage(inst, doFinalize, &inst->finalizeIdx);
+    load.join();
+    compress.join();
+    decompress.join();
+    return;
+  }
+  
+  while(!quit && !isFinished(inst)) {
+    doLoad(inst);
+    doCompressor(inst);
+    doDecompressor(inst);
+    doFinalize(inst);
+    
+    #if SAVABLE_ENABLE
+    if(strcmp(options.checkpoint, "-") && (stopRequested ||
+        std::chrono::steady_clock::now() >= nextCheckpoint)) {
+      // a failed save is reported, and the run goes on
+      saveCheckpoint(inst);
+      nextCheckpoint = std::chrono::steady_clock::now() +
+        std::chrono::seconds(options.checkpointInterval);
+      quit = stopRequested;
+    }
+    #endif
+  }
+}
+
+// Work queued in an instance of the pool: pages in flight for least-loaded
+// dispatch, and for size-aware dispatch the bytes waiting for its modules
+// (raw bytes for the compressor, compressed bytes for the decompressor).
+static size_t poolLoad(Instance *inst) {
+  bool bytes = options.dispatch == DISPATCH_SIZE_AWARE;
+  size_t load = 0;
+  for(int i = 0; i < options.jobQueueSize; i++) {
+    Job *job = &inst->jobs[i];
+    if(job->stage == STAGE_COMPRESSOR)
+      load += bytes ? job->rawLen : 1;
+    else if(job->stage == STAGE_DECOMPRESSOR)
+      load += bytes ? (bq_size(&job->compressed) + 7) / 8 : 1;
+    else if(job->stage == STAGE_FINALIZE && !bytes)
+      load += 1;
+  }
+  return load;
+}
+
+// Hand pages to the instances of the pool while they have free job slots.
+// Round-robin gives the instances a page each in turn and waits for the one
+// whose turn it is; least-loaded and size-aware pick the instance with the
+// least work queued (see poolLoad), the first one on ties.
+static void dispatchPages() {
+  while(!poolDrained) {
+    Instance *inst = NULL;
+    if(options.dispatch == DISPATCH_ROUND_ROBIN) {
+      inst = &instances[poolTurn];
+      if(inst->jobs[inst->loadIdx].stage != STAGE_LOAD)
+        return;
+    }
+    else {
+      size_t least = 0;
+      for(int i = 0; i < instanceCount; i++) {
+        Instance *other = &instances[i];
+        if(other->jobs[other->loadIdx].stage != STAGE_LOAD)
+          continue;
+        size_t load = poolLoad(other);
+        if(inst == NULL || load < least) {
+          inst = other;
+          least = load;
+        }
+      }
+      if(inst == NULL)
+        return;
+    }
+    
+    int idx = inst->loadIdx;
+    doLoad(inst);
+    if(inst->jobs[idx].stage == STAGE_FINISH)
+      poolDrained = true;
+    else if(inst->loadIdx != idx)
+      poolTurn = (poolTurn + 1) % instanceCount;
+    // zero pages are dropped by doLoad, and the instance gets another page
+  }
+  
+  // end-of-dump markers, as slots come free
+  for(int i = 0; i < instanceCount; i++)
+    doLoad(&instances[i]);
+}
+
+// Run the instances of the pool in lock-step on one thread. Each pool cycle
+// hands out pages, clocks every module with a page to work on once, and
+// finalizes the pages that came out.
+static void runPool() {
+  bool finished = false;
+  while(!quit && !finished) {
+    dispatchPages();
+    bool compressing = false;
+    bool decompressing = false;
+    for(int i = 0; i < instanceCount; i++)
+      compressing |= stepCompressor(&instances[i]);
+    for(int i = 0; i < instanceCount; i++)
+      decompressing |= stepDecompressor(&instances[i]);
+    poolCompressorCycles += compressing;
+    poolDecompressorCycles += decompressing;
+    
+    finished = true;
+    for(int i = 0; i < instanceCount; i++) {
+      while(doFinalize(&instances[i]));
+      finished = finished && isFinished(&instances[i]);
+    }
+  }
+}
+
+static void requestStop(int sig) {
+  stopRequested = 1;
 }
 
 int main(int argc, const char **argv, char **env) {
   options.dump = "-";
   options.dumpSeek = 0;
-  options.dumpLimit = LONG_MAX;
+  options.dumpLimit = SIZE_MAX;
+  options.pageSize = PAGE_SIZE;
   options.report = "-";
+  options.results = "-";
   options.cTrace = "-";
   options.dTrace = "-";
+  options.traceWindow = TRACE_WINDOW_ALL;
   options.debugJob = "-1";
   options.debugRDump = "-";
   options.debugCDump = "-";
   options.debugDDump = "-";
+  options.workers = 1;
+  options.jobQueueSize = JOB_QUEUE_SIZE;
+  options.stageThreads = false;
+  options.mmap = true;
+  options.compress = COMPRESS_HARDWARE;
+  options.verify = VERIFY_HARDWARE;
+  options.clocking = CLOCKING_FULL;
+  options.dedup = false;
+  options.checkpoint = "-";
+  options.resume = "-";
+  options.checkpointInterval = CHECKPOINT_INTERVAL;
+  options.archive = "-";
+  options.replay = "-";
+  options.accessTrace = "-";
+  options.accessInstances = 1;
+  options.accessClock = ACCESS_CLOCK;
+  options.pool = 1;
+  options.dispatch = DISPATCH_ROUND_ROBIN;
+  options.sample = 1;
+  options.sampleStrata = SAMPLE_STRATA;
+  options.abortThreshold = 0;
+  options.samePages = SAME_PAGES_OFF;
+  options.compareSoft = false;
   for(int i = 1; i < argc; i++) {
     if(!strcmp(argv[i], "--dump")) {
       ++i;
@@ -213,13 +1545,24 @@ int main(int argc, const char **argv, char **env) {
     else if(!strcmp(argv[i], "--dump-limit")) {
       ++i;
       assert(i < argc);
-      options.dumpLimit = atol(argv[i]);
+      options.dumpLimit = strtoul(argv[i], NULL, 10);
+    }
+    else if(!strcmp(argv[i], "--page-size")) {
+      ++i;
+      assert(i < argc);
+      options.pageSize = strtoul(argv[i], NULL, 10);
+      assert(options.pageSize > 0);
     }
     else if(!strcmp(argv[i], "--report")) {
       ++i;
       assert(i < argc);
       options.report = argv[i];
     }
+    else if(!strcmp(argv[i], "--results")) {
+      ++i;
+      assert(i < argc);
+      options.results = argv[i];
+    }
     else if(!strcmp(argv[i], "--c-trace")) {
       ++i;
       assert(i < argc);
@@ -230,6 +1573,23 @@ int main(int argc, const char **argv, char **env) {
       assert(i < argc);
       options.dTrace = argv[i];
     }
+    else if(!strcmp(argv[i], "--trace-window")) {
+      ++i;
+      assert(i < argc);
+      char end;
+      if(!strcmp(argv[i], "all"))
+        options.traceWindow = TRACE_WINDOW_ALL;
+      else if(!strcmp(argv[i], "debug-job"))
+        options.traceWindow = TRACE_WINDOW_DEBUG_JOB;
+      else if(sscanf(argv[i], "%lu:%lu%c", &options.traceFirst,
+          &options.traceLast, &end) == 2)
+        options.traceWindow = TRACE_WINDOW_CYCLES;
+      else {
+        fprintf(stderr, "error: --trace-window must be all, debug-job or "
+          "<first cycle>:<last cycle>\n");
+        return 127;
+      }
+    }
     else if(!strcmp(argv[i], "--debug-job")) {
       ++i;
       assert(i < argc);
@@ -245,422 +1605,1494 @@ int main(int argc, const char **argv, char **env) {
       assert(i < argc);
       options.debugCDump = argv[i];
     }
-    else if(!strcmp(argv[i], "--debug-d-dump")) {
-      ++i;
-      assert(i < argc);
-      options.debugDDump = argv[i];
+    else if(!strcmp(argv[i], "--debug-d-dump")) {
+      ++i;
+      assert(i < argc);
+      options.debugDDump = argv[i];
+    }
+    else if(!strcmp(argv[i], "--workers")) {
+      ++i;
+      assert(i < argc);
+      options.workers = atoi(argv[i]);
+      if(options.workers <= 0)
+        options.workers = std::thread::hardware_concurrency();
+      assert(options.workers > 0);
+    }
+    else if(!strcmp(argv[i], "--job-queue-size")) {
+      ++i;
+      assert(i < argc);
+      options.jobQueueSize = atoi(argv[i]);
+      assert(options.jobQueueSize >= MIN_JOB_QUEUE_SIZE);
+    }
+    else if(!strcmp(argv[i], "--stage-threads")) {
+      options.stageThreads = true;
+    }
+    else if(!strcmp(argv[i], "--no-mmap")) {
+      options.mmap = false;
+    }
+    else if(!strcmp(argv[i], "--compress")) {
+      ++i;
+      assert(i < argc);
+      if(!strcmp(argv[i], "hardware"))
+        options.compress = COMPRESS_HARDWARE;
+      else if(!strcmp(argv[i], "software"))
+        options.compress = COMPRESS_SOFTWARE;
+      else {
+        fprintf(stderr, "error: --compress must be hardware or software\n");
+        return 127;
+      }
+    }
+    else if(!strcmp(argv[i], "--verify")) {
+      ++i;
+      assert(i < argc);
+      if(!strcmp(argv[i], "hardware"))
+        options.verify = VERIFY_HARDWARE;
+      else if(!strcmp(argv[i], "software"))
+        options.verify = VERIFY_SOFTWARE;
+      else {
+        fprintf(stderr, "error: --verify must be hardware or software\n");
+        return 127;
+      }
+    }
+    else if(!strcmp(argv[i], "--dedup")) {
+      options.dedup = true;
+    }
+    else if(!strcmp(argv[i], "--clocking")) {
+      ++i;
+      assert(i < argc);
+      if(!strcmp(argv[i], "full"))
+        options.clocking = CLOCKING_FULL;
+      else if(!strcmp(argv[i], "minimal"))
+        options.clocking = CLOCKING_MINIMAL;
+      else {
+        fprintf(stderr, "error: --clocking must be full or minimal\n");
+        return 127;
+      }
+    }
+    else if(!strcmp(argv[i], "--checkpoint")) {
+      ++i;
+      assert(i < argc);
+      options.checkpoint = argv[i];
+    }
+    else if(!strcmp(argv[i], "--checkpoint-interval")) {
+      ++i;
+      assert(i < argc);
+      options.checkpointInterval = atoi(argv[i]);
+      assert(options.checkpointInterval >= 0);
+    }
+    else if(!strcmp(argv[i], "--resume")) {
+      ++i;
+      assert(i < argc);
+      options.resume = argv[i];
+    }
+    else if(!strcmp(argv[i], "--archive")) {
+      ++i;
+      assert(i < argc);
+      options.archive = argv[i];
+    }
+    else if(!strcmp(argv[i], "--replay")) {
+      ++i;
+      assert(i < argc);
+      options.replay = argv[i];
+    }
+    else if(!strcmp(argv[i], "--access-trace")) {
+      ++i;
+      assert(i < argc);
+      options.accessTrace = argv[i];
+    }
+    else if(!strcmp(argv[i], "--access-instances")) {
+      ++i;
+      assert(i < argc);
+      options.accessInstances = atoi(argv[i]);
+      assert(options.accessInstances > 0);
+    }
+    else if(!strcmp(argv[i], "--access-clock")) {
+      ++i;
+      assert(i < argc);
+      options.accessClock = atof(argv[i]);
+      assert(options.accessClock > 0);
+    }
+    else if(!strcmp(argv[i], "--pool")) {
+      ++i;
+      assert(i < argc);
+      options.pool = atoi(argv[i]);
+      assert(options.pool > 0);
+    }
+    else if(!strcmp(argv[i], "--dispatch")) {
+      ++i;
+      assert(i < argc);
+      if(!strcmp(argv[i], "round-robin"))
+        options.dispatch = DISPATCH_ROUND_ROBIN;
+      else if(!strcmp(argv[i], "least-loaded"))
+        options.dispatch = DISPATCH_LEAST_LOADED;
+      else if(!strcmp(argv[i], "size-aware"))
+        options.dispatch = DISPATCH_SIZE_AWARE;
+      else {
+        fprintf(stderr, "error: --dispatch must be round-robin, "
+          "least-loaded or size-aware\n");
+        return 127;
+      }
+    }
+    else if(!strcmp(argv[i], "--sample")) {
+      ++i;
+      assert(i < argc);
+      options.sample = atof(argv[i]);
+      assert(options.sample > 0 && options.sample <= 1);
+    }
+    else if(!strcmp(argv[i], "--sample-strata")) {
+      ++i;
+      assert(i < argc);
+      options.sampleStrata = atoi(argv[i]);
+      assert(options.sampleStrata > 0 &&
+        options.sampleStrata <= MAX_SAMPLE_STRATA);
+    }
+    else if(!strcmp(argv[i], "--abort-threshold")) {
+      ++i;
+      assert(i < argc);
+      options.abortThreshold = atol(argv[i]);
+      // the width of the modules' abort limit
+      assert(options.abortThreshold >= 0 &&
+        options.abortThreshold <= UINT32_MAX);
+    }
+    else if(!strcmp(argv[i], "--same-pages")) {
+      ++i;
+      assert(i < argc);
+      if(!strcmp(argv[i], "off"))
+        options.samePages = SAME_PAGES_OFF;
+      else if(!strcmp(argv[i], "simulate"))
+        options.samePages = SAME_PAGES_SIMULATE;
+      else if(!strcmp(argv[i], "bypass"))
+        options.samePages = SAME_PAGES_BYPASS;
+      else {
+        fprintf(stderr,
+          "error: --same-pages must be off, simulate or bypass\n");
+        return 127;
+      }
+    }
+    else if(!strcmp(argv[i], "--compare-soft")) {
+      options.compareSoft = true;
+    }
+  }
+  debugJobId = atoi(options.debugJob);
+  #if SOFT_CODEC
+  softParams = sd_generatedParams();
+  #else
+  if(options.compress == COMPRESS_SOFTWARE ||
+      options.verify == VERIFY_SOFTWARE || options.compareSoft) {
+    fprintf(stderr, "error: the software codec is only built for Deflate\n");
+    return 127;
+  }
+  #endif
+  bool resuming = !!strcmp(options.resume, "-");
+  bool checkpointing = resuming || strcmp(options.checkpoint, "-");
+  #if !SAVABLE_ENABLE
+  if(checkpointing) {
+    fprintf(stderr, "error: checkpoints need models verilated with "
+      "--savable\n");
+    return 127;
+  }
+  #endif
+  if(checkpointing && (options.workers > 1 || options.stageThreads)) {
+    fprintf(stderr, "error: checkpoints need a single worker without "
+      "--stage-threads\n");
+    return 127;
+  }
+  bool replaying = !!strcmp(options.replay, "-");
+  writeArchive = !!strcmp(options.archive, "-");
+  if(replaying) {
+    if(strcmp(options.dump, "-") || options.compress != COMPRESS_HARDWARE ||
+        options.dedup || writeArchive || checkpointing) {
+      fprintf(stderr, "error: --replay replaces --dump and --compress, and "
+        "takes no --dedup, --archive or checkpoints\n");
+      return 127;
+    }
+    options.compress = COMPRESS_ARCHIVE;
+    // pages are reported under the name of the archive
+    options.dump = options.replay;
+  }
+  if(writeArchive && options.dedup) {
+    // reused pages have no stream of their own, so the archive would miss
+    // them
+    fprintf(stderr, "error: --archive takes no --dedup\n");
+    return 127;
+  }
+  if(options.compareSoft && options.compress != COMPRESS_HARDWARE) {
+    // there is no hardware stream to compare
+    fprintf(stderr, "error: --compare-soft needs the hardware compressor\n");
+    return 127;
+  }
+  if(replaying && options.abortThreshold) {
+    // archives hold only pages that were not aborted
+    fprintf(stderr, "error: --abort-threshold needs a --dump\n");
+    return 127;
+  }
+  if(replaying && options.samePages == SAME_PAGES_BYPASS) {
+    // archives keep only the compressed pages, so there is no word to find
+    fprintf(stderr, "error: --same-pages bypass needs a --dump\n");
+    return 127;
+  }
+  if(replaying && options.sample < 1) {
+    // archives keep only the compressed pages, so there is nothing to
+    // stratify them by
+    fprintf(stderr, "error: --sample needs a --dump\n");
+    return 127;
+  }
+  bool accessTracing = !!strcmp(options.accessTrace, "-");
+  accesses = NULL;
+  accessCount = 0;
+  accessPages = NULL;
+  if(accessTracing) {
+    if(replaying) {
+      // archives keep no page indices
+      fprintf(stderr, "error: --access-trace needs a --dump\n");
+      return 127;
+    }
+    if(options.sample < 1) {
+      // unsampled pages have no cycles to serve their accesses with
+      fprintf(stderr, "error: --access-trace takes no --sample\n");
+      return 127;
+    }
+    size_t line;
+    const char *err = at_read(options.accessTrace, &accesses, &accessCount,
+      &line);
+    if(err != NULL) {
+      fprintf(stderr, "error: %s:%lu: %s\n", options.accessTrace, line, err);
+      return 127;
     }
   }
-  debugJobId = atoi(options.debugJob);
-  
-  
-  compressorContext = new VerilatedContext;
-  decompressorContext = new VerilatedContext;
-  compressorContext->commandArgs(argc, argv);
-  decompressorContext->commandArgs(argc, argv);
-  compressor = new VCOMPRESSOR{compressorContext, "TOP_COMPRESSOR"};
-  decompressor = new VDECOMPRESSOR{decompressorContext, "TOP_DECOMPRESSOR"};
-  
-  #if TRACE_ENABLE
-  compressorTraceEnable = !!strcmp(options.cTrace, "-");
-  if(compressorTraceEnable) {
-    compressorContext->traceEverOn(true);
-    compressorTrace = new VerilatedVcdC;
-    compressor->trace(compressorTrace, 99);
-    compressorTrace->open(options.cTrace);
+  if(options.pool > 1 && (options.workers > 1 || options.stageThreads ||
+      options.compress != COMPRESS_HARDWARE ||
+      options.verify != VERIFY_HARDWARE || options.dedup || checkpointing)) {
+    // the pool clocks both modules of every instance itself
+    fprintf(stderr, "error: --pool simulates both modules on one thread, and "
+      "takes no --workers, --stage-threads, software codec, --dedup, "
+      "--replay or checkpoints\n");
+    return 127;
   }
-  
-  decompressorTraceEnable = !!strcmp(options.dTrace, "-");
-  if(decompressorTraceEnable) {
-    decompressorContext->traceEverOn(true);
-    decompressorTrace = new VerilatedVcdC;
-    decompressor->trace(decompressorTrace, 99);
-    decompressorTrace->open(options.dTrace);
+  instanceCount = options.pool > 1 ? options.pool : options.workers;
+  if(options.pageSize > MAX_PAGE_SIZE) {
+    fprintf(stderr, "error: --page-size is at most %d bytes\n", MAX_PAGE_SIZE);
+    return 127;
   }
-  #endif
+  
   
   dumpfile = stdin;
-  if(strcmp(options.dump, "-"))
-    dumpfile = fopen(options.dump, "r");
-  fseek(dumpfile, options.dumpSeek, SEEK_SET);
+  dumpSize = 0;
+  dumpPages = 0;
+  dumpMap = NULL;
+  if(replaying) {
+    const char *err = ar_open(&replayArchive, options.replay, STREAM);
+    if(err != NULL) {
+      fprintf(stderr, "error: %s: %s\n", options.replay, err);
+      return 127;
+    }
+    // archived pages are claimed like the pages of a dump
+    dumpPages = replayArchive.count;
+    // replayed pages keep the size they were archived with
+    options.pageSize = replayArchive.pageSize;
+  }
+  else {
+    if(strcmp(options.dump, "-"))
+      dumpfile = fopen(options.dump, "r");
+    fseek(dumpfile, options.dumpSeek, SEEK_SET);
+    
+    struct stat st;
+    dumpfd = fileno(dumpfile);
+    if(!fstat(dumpfd, &st) && S_ISREG(st.st_mode)) {
+      dumpSize = st.st_size > options.dumpSeek ?
+        min(st.st_size - options.dumpSeek, options.dumpLimit) : 0;
+      dumpPages = (dumpSize + options.pageSize - 1) / options.pageSize;
+      
+      if(options.mmap && dumpSize > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, dumpfd, 0);
+        if(map != MAP_FAILED) {
+          // each worker reads its range of pages front to back exactly once
+          madvise(map, st.st_size, MADV_SEQUENTIAL);
+          dumpMap = (uint8_t*)map;
+          dumpMapLen = st.st_size;
+        }
+      }
+    }
+    else if(options.workers > 1) {
+      // workers read pages at random offsets, so the dump must be a real file
+      fprintf(stderr, "error: --workers requires a seekable dump file\n");
+      return 127;
+    }
+    else if(options.pool > 1) {
+      // so do the instances of a pool
+      fprintf(stderr, "error: --pool requires a seekable dump file\n");
+      return 127;
+    }
+    else if(checkpointing) {
+      // a resumed run seeks to where the checkpoint left the dump
+      fprintf(stderr, "error: checkpoints require a seekable dump file\n");
+      return 127;
+    }
+    else if(accessTracing) {
+      // the trace may name any page of the dump
+      fprintf(stderr, "error: --access-trace requires a seekable dump "
+        "file\n");
+      return 127;
+    }
+    if(accessTracing) {
+      accessPages = (struct AccessPage*)calloc(max(dumpPages, 1),
+        sizeof(struct AccessPage));
+      if(accessPages == NULL) {
+        fprintf(stderr, "error: out of memory for the pages of %s\n",
+          options.accessTrace);
+        return 127;
+      }
+    }
+  }
+  const char *mismatch = sd_pageSizeMismatch(LIMIT_CAM_SIZE,
+    LIMIT_MAX_CHARS_TO_ENCODE, LIMIT_PASS_ONE_SIZE, options.pageSize);
+  if(mismatch != NULL)
+    fprintf(stderr, "warning: %lu-byte pages: %s\n", options.pageSize,
+      mismatch);
   
   reportfile = stdout;
   if(strcmp(options.report, "-"))
-    reportfile = fopen(options.report, "w");
-  
-  for(int i = 0; i < JOB_QUEUE_SIZE; i++) {
-    jobs[i].stage = 0;
-    jobs[i].raw = NULL;
-    jobs[i].rawLen = 0;
-    jobs[i].rawCap = 0;
-    jobs[i].compressed = NULL;
-    jobs[i].compressedLen = 0;
-    jobs[i].compressedCap = 0;
-    jobs[i].decompressed = NULL;
-    jobs[i].decompressedLen = 0;
-    jobs[i].decompressedCap = 0;
-    jobs[i].compressorCycles = 0;
-    jobs[i].decompressorCycles = 0;
-    jobs[i].compressorStallCycles = 0;
-    jobs[i].decompressorStallCycles = 0;
-  }
-  
-  summary.totalSize = 0;
-  summary.totalPages = 0;
-  summary.nonzeroSize = 0;
-  summary.nonzeroPages = 0;
-  summary.passedPages = 0;
-  summary.failedPages = 0;
-  summary.compressorCycles = 0;
-  summary.compressorStalls = 0;
-  summary.decompressorCycles = 0;
-  summary.decompressorStalls = 0;
-  
-  // assert reset on rising edge to initialize module state
-  compressor->reset = 1;
-  compressor->clock = 0;
-  compressor->eval();
-  COMPRESSOR_TRACE(400);
-  compressor->clock = 1;
-  compressor->eval();
-  COMPRESSOR_TRACE(50);
-  compressor->reset = 0;
+    reportfile = fopen(options.report, resuming ? "r+" : "w");
+  if(reportfile == NULL) {
+    fprintf(stderr, "error: cannot write %s\n", options.report);
+    return 127;
+  }
+  writeResults = !!strcmp(options.results, "-");
+  // resumed results and archive files are reopened with the checkpoint
+  if(writeResults && !resuming &&
+      !rw_open(&resultWriter, options.results, options.pageSize,
+        options.dump, NUM_COMPRESSOR_STAGES, compressorStageNames)) {
+    fprintf(stderr, "error: cannot write %s\n", options.results);
+    return 127;
+  }
+  if(writeArchive && !resuming &&
+      !aw_open(&archiveWriter, options.archive, STREAM, options.pageSize,
+        options.dump)) {
+    fprintf(stderr, "error: cannot write %s\n", options.archive);
+    return 127;
+  }
   
-  decompressor->reset = 1;
-  decompressor->clock = 0;
-  decompressor->eval();
-  DECOMPRESSOR_TRACE(400);
-  decompressor->clock = 1;
-  decompressor->eval();
-  DECOMPRESSOR_TRACE(50);
-  decompressor->reset = 0;
+  instances = new Instance[instanceCount];
+  for(int i = 0; i < instanceCount; i++)
+    initInstance(&instances[i], i, argc, argv);
+  #if SAVABLE_ENABLE
+  if(resuming && !restoreCheckpoint(&instances[0]))
+    return 127;
+  #endif
   
   quit = false;
-  while(!quit && !isFinished()) {
-    doLoad();
-    doCompressor();
-    doDecompressor();
-    doFinalize();
+  runStart = std::chrono::steady_clock::now();
+  nextCheckpoint = runStart + std::chrono::seconds(options.checkpointInterval);
+  // preempted jobs get SIGTERM first
+  if(strcmp(options.checkpoint, "-"))
+    signal(SIGTERM, requestStop);
+  if(options.pool > 1) {
+    runPool();
+  }
+  else if(options.workers == 1) {
+    runInstance(&instances[0]);
+  }
+  else {
+    std::thread *threads = new std::thread[options.workers];
+    for(int i = 0; i < options.workers; i++)
+      threads[i] = std::thread(runInstance, &instances[i]);
+    for(int i = 0; i < options.workers; i++)
+      threads[i].join();
+    delete[] threads;
+  }
+  std::chrono::duration<double> wallTime =
+    std::chrono::steady_clock::now() - runStart;
+  
+  if(stopRequested) {
+    fprintf(stderr, "stopped; resume with --resume %s\n", options.checkpoint);
+    if(writeResults)
+      fclose(resultWriter.file);
+    if(writeArchive)
+      fclose(archiveWriter.file);
+    cleanup();
+    delete[] instances;
+    return 127;
+  }
+  
+  memset(&summary, 0, sizeof(summary));
+  for(int i = 0; i < instanceCount; i++)
+    addSummary(&summary, &instances[i].summary);
+  if(options.compress == COMPRESS_ARCHIVE) {
+    // the pages of the original run that were never archived
+    summary.totalPages += replayArchive.unarchivedPages;
+    summary.totalSize += replayArchive.unarchivedSize;
   }
   
   fprintf(reportfile, "\n***** SUMMARY *****\n");
   fprintf(reportfile, "dumps: %s\n", options.dump);
+  fprintf(reportfile, "page size (bytes): %lu\n", options.pageSize);
   fprintf(reportfile, "total (bytes): %lu\n", summary.totalSize);
-  fprintf(reportfile, "total (pages): %d\n", summary.totalPages);
+  fprintf(reportfile, "total (pages): %lu\n", summary.totalPages);
   fprintf(reportfile, "non-zero (bytes): %lu\n", summary.nonzeroSize);
-  fprintf(reportfile, "non-zero (pages): %d\n", summary.nonzeroPages);
-  fprintf(reportfile, "passed (pages): %d\n", summary.passedPages);
-  fprintf(reportfile, "failed (pages): %d\n", summary.failedPages);
+  fprintf(reportfile, "non-zero (pages): %lu\n", summary.nonzeroPages);
+  fprintf(reportfile, "passed (pages): %lu\n", summary.passedPages);
+  fprintf(reportfile, "failed (pages): %lu\n", summary.failedPages);
   fprintf(reportfile, "pass rate: %f\n", (double)summary.passedPages / summary.nonzeroPages);
   fprintf(reportfile, "compressed (bits): %lu\n", summary.compressedSize);
   fprintf(reportfile, "compression ratio: %f\n", (double)summary.nonzeroSize / summary.compressedSize * 8);
-  fprintf(reportfile, "C-cycles: %d\n", summary.compressorCycles);
+  if(options.dedup) {
+    fprintf(reportfile, "duplicate (pages): %lu\n", summary.duplicatePages);
+    fprintf(reportfile, "reused (pages): %lu\n", summary.reusedPages);
+    fprintf(reportfile, "hash collisions (pages): %lu\n",
+      summary.collisionPages);
+    // non-zero pages per distinct page
+    fprintf(reportfile, "dedup ratio: %f\n", (double)summary.nonzeroPages /
+      (summary.nonzeroPages - summary.duplicatePages));
+    fprintf(reportfile, "dedup hit rate: %f\n",
+      (double)summary.reusedPages / summary.nonzeroPages);
+  }
+  if(options.abortThreshold) {
+    fprintf(reportfile, "aborted (pages): %lu\n", summary.abortedPages);
+    fprintf(reportfile, "abort rate: %f\n",
+      (double)summary.abortedPages / summary.nonzeroPages);
+    // stored raw, and counted so in the compressed size
+    fprintf(reportfile, "aborted (bytes): %lu\n", summary.abortedSize);
+    // output by the compressor before giving up, and thrown away
+    fprintf(reportfile, "aborted output (bits): %lu\n", summary.abortedBits);
+    // software compression aborts only once the page is done, saving nothing
+    if(options.compress == COMPRESS_HARDWARE)
+      fprintf(reportfile, "C-cycles saved (estimate): %lu\n",
+        summary.estimatedSavedCycles);
+  }
+  if(options.samePages != SAME_PAGES_OFF) {
+    fprintf(reportfile, "same-value (pages): %lu\n", summary.samePages);
+    fprintf(reportfile, "same-value (bytes): %lu\n", summary.sameSize);
+    fprintf(reportfile, "same-value footprint (bits): %lu\n",
+      summary.sameBits);
+    // what bypassing them saves, or saved
+    fprintf(reportfile, "same-value C-cycles: %lu\n",
+      summary.sameCompressorCycles);
+    fprintf(reportfile, "same-value D-cycles: %lu\n",
+      summary.sameDecompressorCycles);
+  }
+  if(options.compareSoft) {
+    fprintf(reportfile, "compared with software (pages): %lu\n",
+      summary.comparedPages);
+    // Huffman codes chosen differently on ties; the LZ stage always agrees
+    fprintf(reportfile, "differing from software (pages): %lu\n",
+      summary.comparedDiffering);
+    fprintf(reportfile, "software size error: %f\n",
+      ((double)summary.comparedSoftBits - summary.comparedHardwareBits) /
+      summary.comparedHardwareBits);
+  }
+  fprintf(reportfile, "C-cycles: %lu\n", summary.compressorCycles);
   fprintf(reportfile, "C-throughput (B/c): %f\n", (double)summary.nonzeroSize / summary.compressorCycles);
-  fprintf(reportfile, "D-cycles: %d\n", summary.decompressorCycles);
+  fprintf(reportfile, "D-cycles: %lu\n", summary.decompressorCycles);
   fprintf(reportfile, "D-throughput (B/c): %f\n", (double)summary.nonzeroSize / summary.decompressorCycles);
+  // simulated cycles per second of host time, per simulating thread
+  fprintf(reportfile, "C-sim speed (cycles/s): %f\n",
+    summary.compressorCycles / (summary.compressorHostNs / 1e9));
+  fprintf(reportfile, "D-sim speed (cycles/s): %f\n",
+    summary.decompressorCycles / (summary.decompressorHostNs / 1e9));
+  fprintf(reportfile, "wall time (s): %f\n",
+    priorWallTime + wallTime.count());
+  fprintf(reportfile, "page rate (pages/s): %f\n",
+    summary.nonzeroPages / (priorWallTime + wallTime.count()));
+  for(int k = 0; k < NUM_CYCLE_KINDS; k++)
+    fprintf(reportfile, "C-%s (cycles): %lu\n", cycleKindNames[k],
+      summary.compressorCycleKinds[k]);
+  for(int k = 0; k < NUM_CYCLE_KINDS; k++)
+    fprintf(reportfile, "D-%s (cycles): %lu\n", cycleKindNames[k],
+      summary.decompressorCycleKinds[k]);
+  for(int s = 0; s < NUM_COMPRESSOR_STAGES; s++)
+    for(int k = 0; k < NUM_CYCLE_KINDS; k++)
+      fprintf(reportfile, "C-%s-%s (cycles): %lu\n", compressorStageNames[s],
+        cycleKindNames[k], summary.compressorStageKinds[s][k]);
+  struct ResultHistogram hists[RESULT_HISTOGRAMS];
+  mergeLatency(&hists[RESULT_HIST_COMPRESSOR_LATENCY],
+    &Instance::compressorLatency);
+  mergeLatency(&hists[RESULT_HIST_DECOMPRESSOR_LATENCY],
+    &Instance::decompressorLatency);
+  printLatency("C", &hists[RESULT_HIST_COMPRESSOR_LATENCY]);
+  printLatency("D", &hists[RESULT_HIST_DECOMPRESSOR_LATENCY]);
+  if(options.pool > 1)
+    printPool();
+  if(options.sample < 1)
+    printSampling();
+  if(accessPages != NULL)
+    printAccessTrace();
+  
+  if(writeResults) {
+    uint64_t counters[RESULT_MAX_COUNTERS];
+    resultCounters(&summary, counters);
+    rw_close(&resultWriter, counters, hists, summary.strata,
+      options.sample < 1 ? options.sampleStrata : 0);
+  }
+  bool archiveFailed = false;
+  if(writeArchive) {
+    uint64_t archivedSize = 0;
+    for(size_t i = 0; i < archiveWriter.count; i++)
+      archivedSize += archiveWriter.pages[i].rawSize;
+    if(!aw_close(&archiveWriter, summary.totalPages - archiveWriter.count,
+        summary.totalSize - archivedSize)) {
+      fprintf(stderr, "error: cannot complete %s (out of memory or a failed "
+        "write)\n", options.archive);
+      archiveFailed = true;
+    }
+  }
+  // the run is complete, so there is nothing left to resume
+  if(strcmp(options.checkpoint, "-"))
+    unlink(options.checkpoint);
   
   cleanup();
+  delete[] instances;
   
+  if(archiveFailed)
+    return 127;
   return min(summary.failedPages, 127);
 }
 
-static bool doLoad() {
-  static int jobIdx = 0;
-  struct Job *job = &jobs[jobIdx];
+// Claim the next page for a worker. Pages come from the front of the worker's
+// own range; once that is empty, the back half of the fullest other range is
+// stolen. Returns false when no pages remain anywhere.
+static bool claimPage(Instance *inst, long int *page) {
+  // the instances of a pool are handed pages by dispatchPages, all from the
+  // range of the first one
+  if(options.pool > 1)
+    inst = &instances[0];
+  while(true) {
+    {
+      std::lock_guard<std::mutex> guard(inst->pages.lock);
+      if(inst->pages.begin < inst->pages.end) {
+        *page = inst->pages.begin++;
+        return true;
+      }
+    }
+    
+    Instance *victim = NULL;
+    long int victimSize = 0;
+    for(int i = 0; i < options.workers; i++) {
+      Instance *other = &instances[i];
+      if(other == inst) continue;
+      // unlocked peek; the size is re-checked under the lock below
+      long int size = other->pages.end.load(std::memory_order_relaxed) -
+        other->pages.begin.load(std::memory_order_relaxed);
+      if(size > victimSize) {
+        victim = other;
+        victimSize = size;
+      }
+    }
+    if(victim == NULL)
+      return false;
+    
+    long int begin, end;
+    {
+      std::lock_guard<std::mutex> guard(victim->pages.lock);
+      end = victim->pages.end;
+      begin = victim->pages.begin + (end - victim->pages.begin) / 2;
+      if(begin >= end) continue;
+      victim->pages.end = begin;
+    }
+    std::lock_guard<std::mutex> guard(inst->pages.lock);
+    inst->pages.begin = begin;
+    inst->pages.end = end;
+  }
+}
+
+// Put a non-zero page in its stratum of `--sample` (by the entropy of its
+// bytes) and decide whether it is simulated. Each stratum is sampled
+// systematically in load order: its first two pages, so that its variance is
+// known, then one page in every 1/fraction.
+static bool samplePage(Summary *summary, Job *job) {
+  double entropy = pageEntropy(job->raw, job->rawLen);
+  job->stratum = entropy / 8 * options.sampleStrata;
+  if(job->stratum >= options.sampleStrata)
+    job->stratum = options.sampleStrata - 1;
+  struct ResultStratum *s = &summary->strata[job->stratum];
+  s->pages += 1;
+  if(s->sampled >= 2 && floor(s->pages * options.sample) ==
+      floor((s->pages - 1) * options.sample))
+    return false;
+  s->sampled += 1;
+  return true;
+}
+
+// Look a loaded page up among the earlier ones. The first page with some
+// content is simulated; identical pages loaded after it has been finalized
+// reuse its results. A page whose hash matches but whose bytes do not is
+// simulated too.
+static void lookupDuplicate(Summary *summary, Job *job) {
+  job->hash = hashPage(job->raw, job->rawLen);
+  std::lock_guard<std::mutex> guard(dedupLock);
+  auto found = dedupCache.find(job->hash);
+  if(found == dedupCache.end()) {
+    struct DedupEntry *entry = &dedupCache[job->hash];
+    entry->ready = false;
+    entry->pageLen = job->rawLen;
+    if(dumpMap != NULL) {
+      entry->pageOffset = job->raw - dumpMap;
+    }
+    else {
+      // the job's buffer is reused for later pages
+      entry->pageOffset = dedupPages.size();
+      dedupPages.insert(dedupPages.end(), job->raw, job->raw + job->rawLen);
+    }
+    return;
+  }
+  const struct DedupEntry *entry = &found->second;
+  const uint8_t *page = (dumpMap != NULL ? dumpMap : dedupPages.data()) +
+    entry->pageOffset;
+  if(entry->pageLen != job->rawLen || memcmp(page, job->raw, job->rawLen)) {
+    job->collision = true;
+    summary->collisionPages += 1;
+    return;
+  }
+  job->duplicate = true;
+  summary->duplicatePages += 1;
+  if(!entry->ready)
+    return;
+  job->reused = true;
+  job->reusedPass = entry->pass;
+  job->aborted = entry->aborted;
+  job->reusedBits = entry->compressedBits;
+  job->compressorCycles = entry->compressorCycles;
+  job->decompressorCycles = entry->decompressorCycles;
+  memcpy(job->compressorCycleKinds, entry->compressorCycleKinds,
+    sizeof(job->compressorCycleKinds));
+  memcpy(job->decompressorCycleKinds, entry->decompressorCycleKinds,
+    sizeof(job->decompressorCycleKinds));
+  memcpy(job->compressorShareKinds, entry->compressorShareKinds,
+    sizeof(job->compressorShareKinds));
+  memcpy(job->decompressorShareKinds, entry->decompressorShareKinds,
+    sizeof(job->decompressorShareKinds));
+  memcpy(job->compressorStageKinds, entry->compressorStageKinds,
+    sizeof(job->compressorStageKinds));
+  summary->reusedPages += 1;
+}
+
+// record the results of the first page with its content
+static void recordDuplicate(const Job *job, bool pass, size_t compressedBits) {
+  std::lock_guard<std::mutex> guard(dedupLock);
+  struct DedupEntry *entry = &dedupCache[job->hash];
+  entry->pass = pass;
+  entry->aborted = job->aborted;
+  entry->compressedBits = compressedBits;
+  entry->compressorCycles = job->compressorCycles;
+  entry->decompressorCycles = job->decompressorCycles;
+  memcpy(entry->compressorCycleKinds, job->compressorCycleKinds,
+    sizeof(entry->compressorCycleKinds));
+  memcpy(entry->decompressorCycleKinds, job->decompressorCycleKinds,
+    sizeof(entry->decompressorCycleKinds));
+  memcpy(entry->compressorShareKinds, job->compressorShareKinds,
+    sizeof(entry->compressorShareKinds));
+  memcpy(entry->decompressorShareKinds, job->decompressorShareKinds,
+    sizeof(entry->decompressorShareKinds));
+  memcpy(entry->compressorStageKinds, job->compressorStageKinds,
+    sizeof(entry->compressorStageKinds));
+  entry->ready = true;
+}
+
+// Load the next page of the archive being replayed (see `--replay`): its
+// compressed stream and the compressor results recorded with it. The raw page
+// is not archived, so `raw` stays NULL and finalize checks the hash instead.
+static bool doReplayLoad(Instance *inst) {
+  struct Job *job = &inst->jobs[inst->loadIdx];
+  Summary *summary = &inst->summary;
+  if(job->stage != STAGE_LOAD)
+    return false;
+  
+  long int page;
+  if(!claimPage(inst, &page)) {
+    job->stage = STAGE_FINISH;
+    return true;
+  }
+  struct ArchivePage entry;
+  ar_page(&replayArchive, page, &entry);
+  const uint8_t *data = ar_data(&replayArchive, &entry);
+  assert(data != NULL);
+  char err = bq_copyIn(&job->compressed, data, entry.compressedBits);
+  assert(!err);
+  
+  job->id = entry.id;
+  job->rawLen = entry.rawSize;
+  job->hash.lo = entry.hashLo;
+  job->hash.hi = entry.hashHi;
+  job->compressorCycles = entry.compressorCycles;
+  for(int k = 0; k < NUM_CYCLE_KINDS; k++) {
+    job->compressorCycleKinds[k] = entry.compressorKinds[k];
+    job->compressorShareKinds[k] = entry.compressorShareKinds[k];
+  }
+  
+  // only non-zero pages are archived
+  summary->totalPages += 1;
+  summary->totalSize += job->rawLen;
+  summary->nonzeroPages += 1;
+  summary->nonzeroSize += job->rawLen;
+  
+  job->stage++;
+  inst->loadIdx = ++inst->loadIdx % options.jobQueueSize;
+  return true;
+}
+
+static bool doLoad(Instance *inst) {
+  if(options.compress == COMPRESS_ARCHIVE)
+    return doReplayLoad(inst);
+  struct Job *job = &inst->jobs[inst->loadIdx];
+  Summary *summary = &inst->summary;
   if(job->stage != STAGE_LOAD)
     return false;
-  if(job->raw == NULL) {
-    job->raw = (uint8_t*)malloc(PAGE_SIZE);
+  if(dumpMap == NULL && job->raw == NULL) {
+    // only needed when pages are copied out of a stream
+    job->raw = (uint8_t*)malloc(options.pageSize);
     assert(job->raw != NULL);
-    job->rawCap = PAGE_SIZE;
-  }
-  
-  size_t bytesRead = fread(
-    job->raw + job->rawLen,
-    1,
-    min(PAGE_SIZE - job->rawLen, options.dumpLimit - summary.totalSize),
-    dumpfile);
-  job->rawLen += bytesRead;
-  
-  if(job->rawLen == PAGE_SIZE || summary.totalSize == options.dumpLimit ||
-    feof(dumpfile)
-  ) {
-    // finished loading page
-    bool zero = true;
-    for(int i = 0; i < job->rawLen; i++)
-      zero = zero && job->raw[i] == 0;
+    job->rawCap = options.pageSize;
+  }
+  
+  long int page = -1;
+  bool loaded;
+  if(dumpMap != NULL) {
+    // pages are handed out straight from the mapping without copying; the
+    // mapping is read-only, and nothing downstream writes to `raw`
+    job->rawLen = 0;
+    if(claimPage(inst, &page)) {
+      long int offset = page * options.pageSize;
+      job->raw = dumpMap + options.dumpSeek + offset;
+      job->rawLen = min(options.pageSize, dumpSize - offset);
+    }
+    loaded = true;
+  }
+  else if(instanceCount > 1) {
+    // workers load whole pages from arbitrary offsets in the dump
+    job->rawLen = 0;
+    if(claimPage(inst, &page)) {
+      long int offset = page * options.pageSize;
+      ssize_t bytesRead = pread(dumpfd, job->raw,
+        min(options.pageSize, dumpSize - offset),
+        options.dumpSeek + offset);
+      assert(bytesRead >= 0);
+      job->rawLen = bytesRead;
+    }
+    loaded = true;
+  }
+  else {
+    // the page being read is not in the total yet
+    size_t readSize = summary->totalSize + job->rawLen;
+    size_t bytesRead = fread(
+      job->raw + job->rawLen,
+      1,
+      min(options.pageSize - job->rawLen, options.dumpLimit - readSize),
+      dumpfile);
+    job->rawLen += bytesRead;
+    loaded = job->rawLen == options.pageSize ||
+      readSize + bytesRead == options.dumpLimit || feof(dumpfile);
+  }
+  
+  if(loaded) {
+    // finished loading page; pages read in order are counted as they come
+    bool zero = isZeroPage(job->raw, job->rawLen);
+    bool same = !zero && options.samePages != SAME_PAGES_OFF &&
+      isSameWordPage(job->raw, job->rawLen);
+    job->page = page >= 0 ? page : summary->totalPages;
     if(job->rawLen == 0) {
       job->stage = STAGE_FINISH;
     }
     else if(zero) {
-      summary.totalPages += 1;
-      summary.totalSize += job->rawLen;
+      if(accessPages != NULL)
+        accessPages[job->page].state = ACCESS_PAGE_ZERO;
+      summary->totalPages += 1;
+      summary->totalSize += job->rawLen;
+      
+      job->rawLen = 0;
+    }
+    else if(same && options.samePages == SAME_PAGES_BYPASS) {
+      // stored as a descriptor of its word and, like zero pages, never sent
+      // to the modules
+      if(accessPages != NULL)
+        accessPages[job->page].state = ACCESS_PAGE_SAME;
+      summary->totalPages += 1;
+      summary->totalSize += job->rawLen;
+      summary->samePages += 1;
+      summary->sameSize += job->rawLen;
+      summary->sameBits += SAME_PAGE_DESCRIPTOR_BITS;
+      // The page is not simulated, so the cycles saved are bounded by the
+      // modules' width: the page's input to the compressor and output from
+      // the decompressor take at least this many cycles.
+      if(options.compress == COMPRESS_HARDWARE)
+        summary->sameCompressorCycles += (job->rawLen +
+          COMPRESSOR_CHARS_IN - 1) / COMPRESSOR_CHARS_IN;
+      if(options.verify == VERIFY_HARDWARE)
+        summary->sameDecompressorCycles += (job->rawLen +
+          DECOMPRESSOR_CHARS_OUT - 1) / DECOMPRESSOR_CHARS_OUT;
+      
+      job->rawLen = 0;
+    }
+    else if(options.sample < 1 && !samplePage(summary, job)) {
+      // left out like zero pages, and only counted
+      summary->totalPages += 1;
+      summary->totalSize += job->rawLen;
+      summary->unsampledPages += 1;
+      summary->unsampledSize += job->rawLen;
       
       job->rawLen = 0;
     }
     else {
-      job->id = summary.nonzeroPages;
+      // Page IDs count non-zero pages, except with multiple instances where
+      // the count is not known up front, so the page index in the dump is
+      // used.
+      job->id = instanceCount > 1 ? page : summary->nonzeroPages;
+      job->sameValue = same;
+      if(options.dedup)
+        lookupDuplicate(summary, job);
       
-      summary.totalPages += 1;
-      summary.totalSize += job->rawLen;
+      summary->totalPages += 1;
+      summary->totalSize += job->rawLen;
       
-      summary.nonzeroPages += 1;
-      summary.nonzeroSize += job->rawLen;
+      summary->nonzeroPages += 1;
+      summary->nonzeroSize += job->rawLen;
       
       job->stage++;
-      jobIdx = ++jobIdx % JOB_QUEUE_SIZE;
+      inst->loadIdx = ++inst->loadIdx % options.jobQueueSize;
     }
   }
   
   return true;
 }
 
-static bool doCompressor() {
-  static int jobIdxIn = 0;
-  static int jobIdxOut = 0;
-  static int inBufIdx = 0;
-  struct Job *jobIn = &jobs[jobIdxIn];
-  struct Job *jobOut = &jobs[jobIdxOut];
-  bool quit = false;
-  int idle = 0;
-  bool onlyOut = jobIn->stage == STAGE_FINISH;
-  if(jobIn->stage != STAGE_COMPRESSOR &&
-      (!onlyOut || jobOut->stage != STAGE_COMPRESSOR)) {
-    return false;
+// Where each module sits in the job ring: the stage it serves, its progress
+// in the instance, and the job buffers it reads and writes.
+struct CompressorStage {
+  typedef StreamHarness<VCOMPRESSOR, CharLane, COMPRESSED_LANE,
+    COMPRESSOR_CHARS_IN, COMPRESSOR_LANES_OUT, RESTARTABLE> Harness;
+  static const int stage = STAGE_COMPRESSOR;
+  
+  static VCOMPRESSOR *module(Instance *inst) {return inst->compressor;}
+  static int &idxIn(Instance *inst) {return inst->compressorIdxIn;}
+  static int &idxOut(Instance *inst) {return inst->compressorIdxOut;}
+  static int &inBufIdx(Instance *inst) {return inst->compressorInBufIdx;}
+  static int &idle(Instance *inst) {return inst->compressorIdle;}
+  static int &cycles(Job *job) {return job->compressorCycles;}
+  static uint64_t &cycles(Summary *summary) {
+    return summary->compressorCycles;
+  }
+  static int *cycleKinds(Job *job) {return job->compressorCycleKinds;}
+  static int *shareKinds(Job *job) {return job->compressorShareKinds;}
+  static uint64_t *cycleKinds(Summary *summary) {
+    return summary->compressorCycleKinds;
+  }
+  static uint64_t &hostNs(Summary *summary) {
+    return summary->compressorHostNs;
   }
   
-  do {
-    if(jobOut->compressedLen + DEFLATE_COMPRESSOR_BITS_OUT > jobOut->compressedCap*8) {
-      size_t newSize = max(jobOut->compressedCap * 2, PAGE_SIZE);
-      while(jobOut->compressedLen + DEFLATE_COMPRESSOR_BITS_OUT > newSize*8)
+  // occupancy of the pipeline stages in the current cycle
+  static const int numStages = NUM_COMPRESSOR_STAGES;
+  static void stageKinds(VCOMPRESSOR *module, int *kinds) {
+    int ports[NUM_COMPRESSOR_STAGES] = {COMPRESSOR_STAGES(STAGE_PORT)};
+    memcpy(kinds, ports, sizeof(ports));
+  }
+  static int (*stageKinds(Job *job))[NUM_CYCLE_KINDS] {
+    return job->compressorStageKinds;
+  }
+  static uint64_t (*stageKinds(Summary *summary))[NUM_CYCLE_KINDS] {
+    return summary->compressorStageKinds;
+  }
+  
+  static size_t inLen(Job *job) {return job->rawLen;}
+  static void read(Job *job, size_t offset, uint8_t *lanes, int n) {
+    Harness::In::read(job->raw, offset, lanes, n);
+  }
+  static void write(Job *job, const uint8_t *lanes, int n) {
+    Harness::Out::write(&job->compressed, lanes, n);
+  }
+  // pages that do not enter the module
+  static bool skips(Job *job) {return job->reused;}
+  static bool aborted(VCOMPRESSOR *module) {return module->abort_aborted;}
+  
+  static void trace(Instance *inst, int t) {COMPRESSOR_TRACE(t);}
+  #if TRACE_ENABLE
+  static bool &traceOn(Instance *inst) {return inst->compressorTraceOn;}
+  #endif
+};
+
+struct DecompressorStage {
+  typedef StreamHarness<VDECOMPRESSOR, COMPRESSED_LANE, CharLane,
+    DECOMPRESSOR_LANES_IN, DECOMPRESSOR_CHARS_OUT, RESTARTABLE> Harness;
+  static const int stage = STAGE_DECOMPRESSOR;
+  
+  static VDECOMPRESSOR *module(Instance *inst) {return inst->decompressor;}
+  static int &idxIn(Instance *inst) {return inst->decompressorIdxIn;}
+  static int &idxOut(Instance *inst) {return inst->decompressorIdxOut;}
+  static int &inBufIdx(Instance *inst) {return inst->decompressorInBufIdx;}
+  static int &idle(Instance *inst) {return inst->decompressorIdle;}
+  static int &cycles(Job *job) {return job->decompressorCycles;}
+  static uint64_t &cycles(Summary *summary) {
+    return summary->decompressorCycles;
+  }
+  static int *cycleKinds(Job *job) {return job->decompressorCycleKinds;}
+  static int *shareKinds(Job *job) {return job->decompressorShareKinds;}
+  static uint64_t *cycleKinds(Summary *summary) {
+    return summary->decompressorCycleKinds;
+  }
+  static uint64_t &hostNs(Summary *summary) {
+    return summary->decompressorHostNs;
+  }
+  
+  // no stage of the decompressor has an occupancy port
+  static const int numStages = 0;
+  static void stageKinds(VDECOMPRESSOR *module, int *kinds) {}
+  static int (*stageKinds(Job *job))[NUM_CYCLE_KINDS] {return NULL;}
+  static uint64_t (*stageKinds(Summary *summary))[NUM_CYCLE_KINDS] {
+    return NULL;
+  }
+  
+  static size_t inLen(Job *job) {return Harness::In::count(&job->compressed);}
+  static void read(Job *job, size_t offset, uint8_t *lanes, int n) {
+    Harness::In::read(&job->compressed, offset, lanes, n);
+  }
+  static void write(Job *job, const uint8_t *lanes, int n) {
+    if(job->decompressedLen + n > job->decompressedCap) {
+      size_t newSize = max(job->decompressedCap * 2, options.pageSize);
+      while(job->decompressedLen + n > newSize)
         newSize *= 2;
-      uint8_t *oldBuf = jobOut->compressed;
-      jobOut->compressed = (uint8_t*)realloc(jobOut->compressed, newSize);
-      assert(jobOut->compressed != NULL);
-      jobOut->compressedCap = newSize;
+      job->decompressed = (uint8_t*)realloc(job->decompressed, newSize);
+      assert(job->decompressed != NULL);
+      job->decompressedCap = newSize;
     }
-    
-    // expose input buffer to module
-    int remaining = jobIn->rawLen - inBufIdx;
-    compressor->io_in_valid = min(remaining, DEFLATE_COMPRESSOR_CHARS_IN);
-    compressor->io_in_last = remaining <= DEFLATE_COMPRESSOR_CHARS_IN;
-    // module input is not in array form, so must use an ugly cast
-    if(!onlyOut) // prevent segfault
-    for(int i = 0; i < compressor->io_in_valid; i++) {
-      (&compressor->io_in_data_0)[i] = jobIn->raw[inBufIdx + i];
-    }
-    if(onlyOut) {
-      compressor->io_in_valid = 0;
-      compressor->io_in_last = false;
+    Harness::Out::write(job->decompressed + job->decompressedLen, lanes, n);
+    job->decompressedLen += n;
+  }
+  // aborted pages are stored raw, so there is nothing to decompress
+  static bool skips(Job *job) {return job->reused || job->aborted;}
+  static bool aborted(VDECOMPRESSOR *module) {return false;}
+  
+  static void trace(Instance *inst, int t) {DECOMPRESSOR_TRACE(t);}
+  #if TRACE_ENABLE
+  static bool &traceOn(Instance *inst) {return inst->decompressorTraceOn;}
+  #endif
+};
+
+// Classify a cycle once the module's outputs are evaluated:
+// - backpressured: the module has more output than the harness takes
+// - busy: lanes moved, or the module is working on a page internally
+// - idle: no page is in the module (nothing of the next page has entered and
+//   nothing of the previous one is left), and none is accepted either
+// - starved: the module would accept input, but there is no page to give it
+template<class Harness>
+static int classifyCycle(typename Harness::Module *module, size_t in,
+    size_t out, bool empty, bool noInput) {
+  if(module->io_out_valid > module->io_out_ready)
+    return CYCLE_BACKPRESSURED;
+  if(in || out)
+    return CYCLE_BUSY;
+  if(noInput && module->io_in_ready)
+    return CYCLE_STARVED;
+  if(empty)
+    return CYCLE_IDLE;
+  return CYCLE_BUSY;
+}
+
+#if TRACE_ENABLE
+// Whether the current cycle of a module is dumped to its trace: always, while
+// the page of `--debug-job` is in the module, or within a range of the
+// instance's cycles of the module.
+template<class Stage>
+static bool inTraceWindow(Instance *inst) {
+  if(options.traceWindow == TRACE_WINDOW_CYCLES) {
+    uint64_t cycle = Stage::cycles(&inst->summary);
+    return cycle >= options.traceFirst && cycle <= options.traceLast;
+  }
+  if(options.traceWindow == TRACE_WINDOW_DEBUG_JOB) {
+    for(int i = Stage::idxOut(inst);; i = (i + 1) % options.jobQueueSize) {
+      Job *job = &inst->jobs[i];
+      if(job->stage == Stage::stage && job->id == debugJobId)
+        return true;
+      if(i == Stage::idxIn(inst))
+        return false;
     }
-    
-    compressor->io_out_ready = DEFLATE_COMPRESSOR_BITS_OUT;
-    compressor->io_out_restart = false;
-    
-    // update outputs based on new inputs
-    compressor->eval();
-    COMPRESSOR_TRACE(50);
-    
-    idle++;
-    
-    // shift input buffer by number of characters consumed by module input
-    size_t c = min(compressor->io_in_valid, compressor->io_in_ready);
-    if(c) idle = 0;
-    inBufIdx += c;
-    
-    // push module output onto the end of output buffer
-    c = min(compressor->io_out_valid, compressor->io_out_ready);
-    // if(c) idle = 0;
-    // module output is not in array form, so must use ugly cast
-    for(int i = 0; i < c; i++) {
-      int major = (jobOut->compressedLen + i) / 8;
-      int minor = (jobOut->compressedLen + i) % 8;
-      jobOut->compressed[major] &= (1 << minor) - 1;
-      jobOut->compressed[major] |= !!(&compressor->io_out_data_0)[i] << minor;
-    }
-    jobOut->compressedLen += c;
-    
-    compressor->io_out_restart = compressor->io_out_last &&
-      compressor->io_out_ready >= compressor->io_out_valid;
-    compressor->eval();
-    COMPRESSOR_TRACE(50);
-    
-    for(int i = jobIdxOut;;i = ++i % JOB_QUEUE_SIZE) {
-      jobs[i].compressorCycles++;
-      if(i == jobIdxIn) break;
+  }
+  return true;
+}
+#endif
+
+// Reused duplicate pages (see `--dedup`) never enter a module, nor do aborted
+// pages enter the decompressor (see Stage::skips). The input side of a module
+// skips them, and the output side hands them on in ring order once the pages
+// before them have left, or at once when the module is empty. Their recorded
+// shares (none for aborted pages) count towards the module's totals as they
+// are handed on. Returns whether any page was handed on.
+template<class Stage>
+static bool skipBypassed(Instance *inst) {
+  Job *jobs = inst->jobs;
+  int &idxIn = Stage::idxIn(inst);
+  int &idxOut = Stage::idxOut(inst);
+  bool passed = false;
+  while(true) {
+    Job *job;
+    if(idxOut != idxIn && Stage::skips(&jobs[idxOut])) {
+      job = &jobs[idxOut];
+      idxOut = (idxOut + 1) % options.jobQueueSize;
     }
-    summary.compressorCycles += 1;
-    
-    if(compressor->io_in_restart) {
-      jobIdxIn = ++jobIdxIn % JOB_QUEUE_SIZE;
-      inBufIdx = 0;
-      jobIn = &jobs[jobIdxIn];
-      quit = quit || jobIn->stage != STAGE_COMPRESSOR;
+    else if(jobs[idxIn].stage == Stage::stage && Stage::skips(&jobs[idxIn])) {
+      job = &jobs[idxIn];
+      bool empty = idxIn == idxOut;
+      idxIn = (idxIn + 1) % options.jobQueueSize;
+      if(!empty)
+        continue;
+      idxOut = idxIn;
     }
-    if(compressor->io_out_restart) {
-      jobIdxOut = ++jobIdxOut % JOB_QUEUE_SIZE;
-      jobOut->stage++;
-      jobOut = &jobs[jobIdxOut];
-      quit = quit || (onlyOut && jobOut->stage != STAGE_COMPRESSOR);
+    else
+      return passed;
+    for(int k = 0; k < NUM_CYCLE_KINDS; k++) {
+      Stage::cycles(&inst->summary) += Stage::shareKinds(job)[k];
+      Stage::cycleKinds(&inst->summary)[k] += Stage::shareKinds(job)[k];
     }
-    
-    
-    // make ure everything is still up to date
-    compressor->eval();
-    COMPRESSOR_TRACE(50);
-    
-    // prepare for rising edge
-    compressor->clock = 0;
-    compressor->eval();
-    COMPRESSOR_TRACE(200);
-    
-    // update module registers with rising edge
-    compressor->clock = 1;
-    compressor->eval();
-    COMPRESSOR_TRACE(50);
-    
-    if(TIMEOUT)
-      cleanup();
-    assert(!TIMEOUT);
-  } while(!quit);
-  
-  return true;
+    job->stage++;
+    passed = true;
+  }
 }
 
-static bool doDecompressor() {
-  static int jobIdxIn = 0;
-  static int jobIdxOut = 0;
-  static int inBufIdx = 0;
+// Simulate one module until the pages of its stage run out. Pages enter the
+// module from the job at `idxIn` and leave it into the job at `idxOut`.
+//
+// With `--clocking full`, a cycle evaluates the model five times: after the
+// inputs, after the restart, once more to settle, with the clock low and with
+// the clock high. `--clocking minimal` lowers the clock together with the new
+// inputs, so the outputs read by the harness and the rising edge take one
+// evaluation each. Only when an output page ends does the restart need an
+// evaluation in between, to update `io_in_restart`.
+//
+// With `oneCycle`, the module is clocked once (if it has a page to work on)
+// so that the caller can interleave several modules cycle by cycle.
+template<class Stage>
+static bool doStream(Instance *inst, bool oneCycle = false) {
+  typedef typename Stage::Harness Harness;
+  typename Harness::Module *module = Stage::module(inst);
+  Job *jobs = inst->jobs;
+  int &jobIdxIn = Stage::idxIn(inst);
+  int &jobIdxOut = Stage::idxOut(inst);
+  int &inBufIdx = Stage::inBufIdx(inst);
+  bool passed = skipBypassed<Stage>(inst);
   struct Job *jobIn = &jobs[jobIdxIn];
   struct Job *jobOut = &jobs[jobIdxOut];
   bool quit = false;
-  int idle = 0;
+  int &idle = Stage::idle(inst);
+  if(!oneCycle)
+    idle = 0;
   bool onlyOut = jobIn->stage == STAGE_FINISH;
-  if(jobIn->stage != STAGE_DECOMPRESSOR &&
-      (!onlyOut || jobOut->stage != STAGE_DECOMPRESSOR)) {
-    return false;
+  if(jobIn->stage != Stage::stage &&
+      (!onlyOut || jobOut->stage != Stage::stage)) {
+    return passed;
   }
+  bool minimal = options.clocking == CLOCKING_MINIMAL;
+  auto start = std::chrono::steady_clock::now();
   
   do {
-    if(jobOut->decompressedLen + DEFLATE_DECOMPRESSOR_CHARS_OUT >
-        jobOut->decompressedCap) {
-      size_t newSize = max(jobOut->decompressedCap * 2, PAGE_SIZE);
-      while(jobOut->decompressedLen + DEFLATE_DECOMPRESSOR_CHARS_OUT > newSize)
-        newSize *= 2;
-      uint8_t *oldBuf = jobOut->decompressed;
-      jobOut->decompressed = (uint8_t*)realloc(jobOut->decompressed, newSize);
-      assert(jobOut->compressed != NULL);
-      jobOut->decompressedCap = newSize;
-    }
+    #if TRACE_ENABLE
+    Stage::traceOn(inst) = inTraceWindow<Stage>(inst);
+    #endif
     
     // expose input buffer to module
-    int remaining = jobIn->compressedLen - inBufIdx;
-    decompressor->io_in_valid = min(remaining, DEFLATE_DECOMPRESSOR_BITS_IN);
-    decompressor->io_in_last = remaining <= DEFLATE_DECOMPRESSOR_BITS_IN;
-    // module input is not in array form, so must use an ugly cast
-    if(!onlyOut)
-    for(int i = 0; i < decompressor->io_in_valid; i++) {
-      int major = (inBufIdx + i) / 8;
-      int minor = (inBufIdx + i) % 8;
-      (&decompressor->io_in_data_0)[i] = jobIn->compressed[major] >> minor & 1;
-    }
-    if(onlyOut) {
-      decompressor->io_in_valid = 0;
-      decompressor->io_in_last = false;
-    }
+    size_t remaining = onlyOut ? 0 : Stage::inLen(jobIn) - inBufIdx;
+    int n = Harness::driveIn(module, remaining, onlyOut);
+    if(n)
+      Stage::read(jobIn, inBufIdx, Harness::inData(module), n);
     
-    decompressor->io_out_ready = DEFLATE_DECOMPRESSOR_CHARS_OUT;
-    decompressor->io_out_restart = false;
+    Harness::driveOut(module);
     
     // update outputs based on new inputs
-    decompressor->eval();
-    DECOMPRESSOR_TRACE(50);
+    if(minimal)
+      module->clock = 0;
+    module->eval();
+    Stage::trace(inst, 50);
     
     idle++;
     
-    // shift input buffer by number of characters consumed by module input
-    size_t c = min(decompressor->io_in_valid, decompressor->io_in_ready);
+    // shift input buffer by number of lanes consumed by module input
+    int inStart = inBufIdx;
+    size_t c = Harness::takenIn(module);
     if(c) idle = 0;
     inBufIdx += c;
     
-    // push module output onto the end of output buffer
-    c = min(decompressor->io_out_valid, decompressor->io_out_ready);
-    // if(c) idle = 0;
-    // module output is not in array form, so must use ugly cast
-    for(int i = 0; i < c; i++) {
-      jobOut->decompressed[jobOut->decompressedLen + i] =
-        (&decompressor->io_out_data_0)[i];
-    }
-    jobOut->decompressedLen += c;
+    // push module output onto the end of output buffer; a large page can
+    // take longer than the timeout to drain
+    c = Harness::takenOut(module);
+    if(c) idle = 0;
+    Stage::write(jobOut, Harness::outData(module), c);
     
-    decompressor->io_out_restart = decompressor->io_out_last &&
-      decompressor->io_out_ready >= decompressor->io_out_valid;
-    decompressor->eval();
-    DECOMPRESSOR_TRACE(50);
+    int kind = classifyCycle<Harness>(module, inBufIdx - inStart, c,
+      jobIdxIn == jobIdxOut && inStart == 0, onlyOut);
+    int stageKinds[NUM_COMPRESSOR_STAGES];
+    Stage::stageKinds(module, stageKinds);
     
+    bool outEnded = Harness::endOut(module);
+    if(outEnded && Stage::aborted(module))
+      jobOut->aborted = true;
+    if(!minimal || (outEnded && Harness::restartable)) {
+      module->eval();
+      Stage::trace(inst, 50);
+    }
     
-    for(int i = jobIdxOut;;i = ++i % JOB_QUEUE_SIZE) {
-      jobs[i].decompressorCycles++;
+    for(int i = jobIdxOut;;i = ++i % options.jobQueueSize) {
+      // skipped pages keep their recorded cycles
+      if(!Stage::skips(&jobs[i])) {
+        Stage::cycles(&jobs[i])++;
+        Stage::cycleKinds(&jobs[i])[kind]++;
+        for(int s = 0; s < Stage::numStages; s++)
+          Stage::stageKinds(&jobs[i])[s][stageKinds[s]]++;
+      }
       if(i == jobIdxIn) break;
     }
-    summary.decompressorCycles += 1;
+    Stage::shareKinds(onlyOut ? jobOut : jobIn)[kind]++;
+    Stage::cycles(&inst->summary) += 1;
+    Stage::cycleKinds(&inst->summary)[kind]++;
+    for(int s = 0; s < Stage::numStages; s++)
+      Stage::stageKinds(&inst->summary)[s][stageKinds[s]]++;
     
-    if(decompressor->io_in_restart) {
-      jobIdxIn = ++jobIdxIn % JOB_QUEUE_SIZE;
+    bool inEnded = Harness::endIn(module, outEnded);
+    if(inEnded) {
+      jobIdxIn = ++jobIdxIn % options.jobQueueSize;
       inBufIdx = 0;
-      jobIn = &jobs[jobIdxIn];
-      quit = quit || jobIn->stage != STAGE_DECOMPRESSOR;
     }
-    if(decompressor->io_out_restart) {
-      jobIdxOut = ++jobIdxOut % JOB_QUEUE_SIZE;
+    if(outEnded) {
+      jobIdxOut = ++jobIdxOut % options.jobQueueSize;
       jobOut->stage++;
+    }
+    if(inEnded || outEnded) {
+      skipBypassed<Stage>(inst);
+      jobIn = &jobs[jobIdxIn];
       jobOut = &jobs[jobIdxOut];
-      quit = quit || (onlyOut && jobOut->stage != STAGE_DECOMPRESSOR);
+      quit = quit || (inEnded && jobIn->stage != Stage::stage);
+      quit = quit || (outEnded && onlyOut && jobOut->stage != Stage::stage);
     }
     
-    
-    decompressor->eval();
-    DECOMPRESSOR_TRACE(50);
-    
     // prepare for rising edge
-    decompressor->clock = 0;
-    decompressor->eval();
-    DECOMPRESSOR_TRACE(200);
+    Harness::beforeEdge(module, outEnded);
+    if(!minimal) {
+      // make sure everything is still up to date
+      module->eval();
+      Stage::trace(inst, 50);
+      
+      module->clock = 0;
+      module->eval();
+      Stage::trace(inst, 200);
+    }
     
     // update module registers with rising edge
-    decompressor->clock = 1;
-    decompressor->eval();
-    DECOMPRESSOR_TRACE(50);
+    module->clock = 1;
+    module->eval();
+    Stage::trace(inst, 50);
+    Harness::afterEdge(module);
     
     if(TIMEOUT)
-      cleanup();
+      abortInstance(inst);
     assert(!TIMEOUT);
-  } while(!quit);
+  } while(!quit && !oneCycle);
+  
+  Stage::hostNs(&inst->summary) +=
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count();
+  return true;
+}
+
+static bool doSoftCompressor(Instance *inst) {
+  int &jobIdx = inst->compressorIdxIn;
+  struct Job *job = &inst->jobs[jobIdx];
+  if(job->stage != STAGE_COMPRESSOR)
+    return false;
+  
+  if(!job->reused) {
+    job->softError = sd_compress(&softParams, &inst->softScratch, job->raw,
+      job->rawLen, &job->compressed);
+    // the whole stream is there, so the abort is decided afterwards
+    job->aborted = options.abortThreshold &&
+      bq_size(&job->compressed) > options.abortThreshold;
+  }
+  
+  jobIdx = ++jobIdx % options.jobQueueSize;
+  inst->compressorIdxOut = jobIdx;
+  job->stage++;
+  
+  return true;
+}
+
+// Pass a replayed page on to the decompressor. Like a reused page (see
+// skipBypassed), its recorded share counts towards the compressor's totals.
+static bool doReplayCompressor(Instance *inst) {
+  int &jobIdx = inst->compressorIdxIn;
+  struct Job *job = &inst->jobs[jobIdx];
+  if(job->stage != STAGE_COMPRESSOR)
+    return false;
+  
+  for(int k = 0; k < NUM_CYCLE_KINDS; k++) {
+    inst->summary.compressorCycles += job->compressorShareKinds[k];
+    inst->summary.compressorCycleKinds[k] += job->compressorShareKinds[k];
+  }
+  
+  jobIdx = ++jobIdx % options.jobQueueSize;
+  inst->compressorIdxOut = jobIdx;
+  job->stage++;
+  
+  return true;
+}
+
+static bool doCompressor(Instance *inst) {
+  if(options.compress == COMPRESS_SOFTWARE)
+    return doSoftCompressor(inst);
+  if(options.compress == COMPRESS_ARCHIVE)
+    return doReplayCompressor(inst);
+  return doStream<CompressorStage>(inst);
+}
+
+// Clock the compressor of a pool instance once. Returns whether it had a page
+// to work on.
+static bool stepCompressor(Instance *inst) {
+  uint64_t cycles = inst->summary.compressorCycles;
+  doStream<CompressorStage>(inst, true);
+  return inst->summary.compressorCycles != cycles;
+}
+
+// Check a page with the software decoder instead of simulating the
+// decompressor. No decompressor cycles are counted in this mode.
+static bool doSoftDecompressor(Instance *inst) {
+  int &jobIdx = inst->decompressorIdxIn;
+  struct Job *job = &inst->jobs[jobIdx];
+  if(job->stage != STAGE_DECOMPRESSOR)
+    return false;
+  
+  // replayed pages may come from a run with another page size
+  size_t cap = max(options.pageSize, job->rawLen);
+  if(job->decompressedCap < cap) {
+    job->decompressed = (uint8_t*)realloc(job->decompressed, cap);
+    assert(job->decompressed != NULL);
+    job->decompressedCap = cap;
+  }
+  if(job->softError == SD_OK && !job->reused && !job->aborted)
+    job->softError = sd_decompress(&softParams, &job->compressed,
+      job->decompressed, job->decompressedCap, &job->decompressedLen);
+  
+  jobIdx = ++jobIdx % options.jobQueueSize;
+  inst->decompressorIdxOut = jobIdx;
+  job->stage++;
+  
+  return true;
+}
+
+static bool doDecompressor(Instance *inst) {
+  if(options.verify == VERIFY_SOFTWARE)
+    return doSoftDecompressor(inst);
+  return doStream<DecompressorStage>(inst);
+}
+
+static bool stepDecompressor(Instance *inst) {
+  uint64_t cycles = inst->summary.decompressorCycles;
+  doStream<DecompressorStage>(inst, true);
+  return inst->summary.decompressorCycles != cycles;
+}
+
+#if SOFT_CODEC
+// Check the hardware stream of a page against the software compressor (see
+// `--compare-soft`). The LZ characters under the Huffman codes must be the
+// ones sd_lzCompress finds. The codes themselves may differ where characters
+// tie in frequency (see SoftDeflate.h), so a differing stream only has to
+// decode to the page.
+static bool compareSoft(Instance *inst, Job *job) {
+  Summary *summary = &inst->summary;
+  size_t cap = 2 * job->rawLen + softParams.minEncodingChars;
+  if(inst->compareCap < cap) {
+    for(int i = 0; i < 2; i++) {
+      inst->compareLz[i] = (uint8_t*)realloc(inst->compareLz[i], cap);
+      assert(inst->compareLz[i] != NULL);
+    }
+    inst->compareCap = cap;
+  }
+  uint8_t *softLz = inst->compareLz[0];
+  uint8_t *hardLz = inst->compareLz[1];
+  
+  size_t softLen, hardLen;
+  int err = sd_lzCompress(&softParams, &inst->softScratch, job->raw,
+    job->rawLen, softLz, cap, &softLen);
+  if(!err)
+    err = sd_huffmanDecode(&softParams, &job->compressed, hardLz, cap,
+      &hardLen);
+  if(err) {
+    fprintf(stderr, "page %d: compare-soft: %s\n", job->id, sd_strerror(err));
+    return false;
+  }
+  if(softLen != hardLen || memcmp(softLz, hardLz, softLen)) {
+    size_t i = 0;
+    while(i < softLen && i < hardLen && softLz[i] == hardLz[i])
+      i++;
+    fprintf(stderr, "page %d: compare-soft: LZ character %lu differs\n",
+      job->id, i);
+    return false;
+  }
   
+  err = sd_compress(&softParams, &inst->softScratch, job->raw, job->rawLen,
+    &inst->compareStream);
+  if(err) {
+    fprintf(stderr, "page %d: compare-soft: %s\n", job->id, sd_strerror(err));
+    return false;
+  }
+  size_t hardBits = bq_size(&job->compressed);
+  size_t softBits = bq_size(&inst->compareStream);
+  summary->comparedPages += 1;
+  summary->comparedHardwareBits += hardBits;
+  summary->comparedSoftBits += softBits;
+  bool same = hardBits == softBits;
+  for(size_t pos = 0; same && pos < hardBits; pos += 64) {
+    int count = hardBits - pos < 64 ? hardBits - pos : 64;
+    uint64_t hard, soft;
+    bq_peekBits(&job->compressed, pos, &hard, count);
+    bq_peekBits(&inst->compareStream, pos, &soft, count);
+    same = hard == soft;
+  }
+  if(same)
+    return true;
+  
+  summary->comparedDiffering += 1;
+  size_t len;
+  err = sd_decompress(&softParams, &inst->compareStream, softLz, cap, &len);
+  if(err || len != job->rawLen || memcmp(softLz, job->raw, len)) {
+    fprintf(stderr, "page %d: compare-soft: software stream does not decode "
+      "to the page\n", job->id);
+    return false;
+  }
   return true;
 }
+#endif
+
+// The most bits a compressor outputs of a page past `--abort-threshold`: it
+// sees the threshold passed only after the beat that passed it.
+static size_t abortedBitsBound() {
+  return options.abortThreshold + COMPRESSOR_LANES_OUT * COMPRESSED_LANE_BITS;
+}
 
-static bool doFinalize() {
-  static int jobIdx = 0;
-  struct Job *job = &jobs[jobIdx];
+static bool doFinalize(Instance *inst) {
+  int &jobIdx = inst->finalizeIdx;
+  struct Job *job = &inst->jobs[jobIdx];
+  Summary *summary = &inst->summary;
   if(job->stage != STAGE_FINALIZE)
     return false;
   
   bool pass = true;
-  if(job->rawLen != job->decompressedLen)
-    pass = false;
-  else
-  for(int i = 0; i < job->rawLen; i++) {
-    pass = pass && job->raw[i] == job->decompressed[i];
+  size_t compressedBits = bq_size(&job->compressed);
+  if(job->reused) {
+    pass = job->reusedPass;
+    compressedBits = job->reusedBits;
+  }
+  else if(job->aborted) {
+    // stored raw, so there is nothing to decompress; the stream so far is
+    // dropped, and must have ended within a beat of passing the threshold
+    summary->abortedBits += compressedBits;
+    if(options.compress == COMPRESS_HARDWARE &&
+        compressedBits > abortedBitsBound()) {
+      fprintf(stderr, "page %d: aborted after %lu bits\n", job->id,
+        compressedBits);
+      pass = false;
+    }
+    // The rest of the page would have taken at least as many output cycles
+    // as a raw copy of it, as the page does not compress.
+    size_t rest = job->rawLen * 8 > compressedBits ?
+      job->rawLen * 8 - compressedBits : 0;
+    if(options.compress == COMPRESS_HARDWARE)
+      summary->estimatedSavedCycles += (rest + COMPRESSOR_LANES_OUT *
+        COMPRESSED_LANE_BITS - 1) / (COMPRESSOR_LANES_OUT *
+        COMPRESSED_LANE_BITS);
+    compressedBits = job->rawLen * 8;
+  }
+  else {
+    if(job->softError != SD_OK) {
+      fprintf(stderr, "page %d: software codec: %s\n", job->id,
+        sd_strerror(job->softError));
+      pass = false;
+    }
+    // a page that passed the threshold before its last beat must have been
+    // aborted
+    if(options.compress == COMPRESS_HARDWARE && options.abortThreshold &&
+        compressedBits > abortedBitsBound()) {
+      fprintf(stderr, "page %d: not aborted after %lu bits\n", job->id,
+        compressedBits);
+      pass = false;
+    }
+    if(job->rawLen != job->decompressedLen)
+      pass = false;
+    else if(options.compress == COMPRESS_ARCHIVE) {
+      // replayed pages are checked against the hash of the original
+      struct PageHash hash = hashPage(job->decompressed, job->decompressedLen);
+      pass = pass && hash.lo == job->hash.lo && hash.hi == job->hash.hi;
+    }
+    else
+    for(int i = 0; i < job->rawLen; i++) {
+      pass = pass && job->raw[i] == job->decompressed[i];
+    }
+    #if SOFT_CODEC
+    if(options.compareSoft)
+      pass = compareSoft(inst, job) && pass;
+    #endif
   }
   if(pass)
-    summary.passedPages += 1;
+    summary->passedPages += 1;
   else
-    summary.failedPages += 1;
+    summary->failedPages += 1;
+  if(job->aborted) {
+    summary->abortedPages += 1;
+    summary->abortedSize += job->rawLen;
+  }
+  if(options.dedup && !job->duplicate && !job->collision)
+    recordDuplicate(job, pass, compressedBits);
+  
+  summary->compressedSize += compressedBits;
+  if(job->sameValue) {
+    summary->samePages += 1;
+    summary->sameSize += job->rawLen;
+    summary->sameBits += compressedBits;
+    for(int k = 0; k < NUM_CYCLE_KINDS; k++) {
+      summary->sameCompressorCycles += job->compressorShareKinds[k];
+      summary->sameDecompressorCycles += job->decompressorShareKinds[k];
+    }
+  }
+  if(job->stratum >= 0) {
+    double y[NUM_SAMPLE_MEASURES] = {(double)compressedBits, 0, 0};
+    for(int k = 0; k < NUM_CYCLE_KINDS; k++) {
+      y[SAMPLE_C_CYCLES] += job->compressorShareKinds[k];
+      y[SAMPLE_D_CYCLES] += job->decompressorShareKinds[k];
+    }
+    struct ResultStratum *s = &summary->strata[job->stratum];
+    for(int m = 0; m < NUM_SAMPLE_MEASURES; m++) {
+      s->sum[m] += y[m];
+      s->sumSq[m] += y[m] * y[m];
+    }
+  }
+  // software stages take no cycles, so they have no latency to report;
+  // replayed pages keep their recorded one
+  if(options.compress != COMPRESS_SOFTWARE)
+    rh_add(&inst->compressorLatency, job->compressorCycles);
+  if(options.verify == VERIFY_HARDWARE && !job->aborted)
+    rh_add(&inst->decompressorLatency, job->decompressorCycles);
+  if(accessPages != NULL) {
+    // each page has its own entry, so no lock is needed
+    struct AccessPage *access = &accessPages[job->page];
+    access->state = ACCESS_PAGE_SIMULATED;
+    access->cycles[ACCESS_READ] = job->decompressorCycles;
+    access->cycles[ACCESS_WRITE] = job->compressorCycles;
+  }
   
-  summary.compressedSize += job->compressedLen;
+  // aborted pages have only part of a stream to archive
+  bool archive = writeArchive && !job->aborted;
+  struct ArchivePage archived;
+  uint8_t *stream = NULL;
+  if(archive) {
+    struct PageHash hash = hashPage(job->raw, job->rawLen);
+    archived.id = job->id;
+    archived.compressedBits = compressedBits;
+    archived.rawSize = job->rawLen;
+    archived.hashLo = hash.lo;
+    archived.hashHi = hash.hi;
+    archived.compressorCycles = job->compressorCycles;
+    for(int k = 0; k < NUM_CYCLE_KINDS; k++) {
+      archived.compressorKinds[k] = job->compressorCycleKinds[k];
+      archived.compressorShareKinds[k] = job->compressorShareKinds[k];
+    }
+    stream = (uint8_t*)malloc((compressedBits + 7) / 8 + 1);
+    assert(stream != NULL);
+    bq_copyOut(&job->compressed, stream);
+  }
   
-  static bool printHeader = true;
+  std::unique_lock<std::mutex> reportGuard(reportLock);
   if(printHeader) {
     printHeader = false;
     fprintf(reportfile, "dump,");
@@ -670,6 +3102,17 @@ static bool doFinalize() {
     fprintf(reportfile, "compressed size,");
     fprintf(reportfile, "cycles in compressor,");
     fprintf(reportfile, "cycles in decompressor,");
+    for(int k = 0; k < NUM_CYCLE_KINDS; k++)
+      fprintf(reportfile, "compressor %s,", cycleKindNames[k]);
+    for(int k = 0; k < NUM_CYCLE_KINDS; k++)
+      fprintf(reportfile, "decompressor %s,", cycleKindNames[k]);
+    fprintf(reportfile, "duplicate?,");
+    for(int s = 0; s < NUM_COMPRESSOR_STAGES; s++)
+      for(int k = 0; k < NUM_CYCLE_KINDS; k++)
+        fprintf(reportfile, "compressor %s %s,", compressorStageNames[s],
+          cycleKindNames[k]);
+    fprintf(reportfile, "aborted?,");
+    fprintf(reportfile, "same-value?,");
     fprintf(reportfile, "\n");
   }
   
@@ -677,11 +3120,46 @@ static bool doFinalize() {
   fprintf(reportfile, "%d,", job->id);
   fprintf(reportfile, "%s,", pass ? "pass" : "fail");
   fprintf(reportfile, "%lu,", job->rawLen);
-  fprintf(reportfile, "%lu,", job->compressedLen);
+  fprintf(reportfile, "%lu,", compressedBits);
   fprintf(reportfile, "%d,", job->compressorCycles);
   fprintf(reportfile, "%d,", job->decompressorCycles);
+  for(int k = 0; k < NUM_CYCLE_KINDS; k++)
+    fprintf(reportfile, "%d,", job->compressorCycleKinds[k]);
+  for(int k = 0; k < NUM_CYCLE_KINDS; k++)
+    fprintf(reportfile, "%d,", job->decompressorCycleKinds[k]);
+  fprintf(reportfile, "%s,",
+    job->reused ? "reused" : job->duplicate ? "yes" : "no");
+  for(int s = 0; s < NUM_COMPRESSOR_STAGES; s++)
+    for(int k = 0; k < NUM_CYCLE_KINDS; k++)
+      fprintf(reportfile, "%d,", job->compressorStageKinds[s][k]);
+  fprintf(reportfile, "%s,", job->aborted ? "yes" : "no");
+  fprintf(reportfile, "%s,", job->sameValue ? "yes" : "no");
   fprintf(reportfile, "\n");
   
+  if(writeResults) {
+    struct ResultPage page;
+    page.id = job->id;
+    page.pass = pass;
+    page.duplicate = job->reused ? RESULT_PAGE_REUSED :
+      job->duplicate ? RESULT_PAGE_DUPLICATE : RESULT_PAGE_UNIQUE;
+    page.aborted = job->aborted;
+    page.sameValue = job->sameValue;
+    page.rawSize = job->rawLen;
+    page.compressedBits = compressedBits;
+    page.compressorCycles = job->compressorCycles;
+    page.decompressorCycles = job->decompressorCycles;
+    for(int k = 0; k < NUM_CYCLE_KINDS; k++) {
+      page.compressorKinds[k] = job->compressorCycleKinds[k];
+      page.decompressorKinds[k] = job->decompressorCycleKinds[k];
+    }
+    for(int s = 0; s < NUM_COMPRESSOR_STAGES; s++)
+      for(int k = 0; k < NUM_CYCLE_KINDS; k++)
+        page.stageKinds[s][k] = job->compressorStageKinds[s][k];
+    rw_page(&resultWriter, &page);
+  }
+  if(archive)
+    aw_page(&archiveWriter, &archived, stream);
+  
   if(job->id == debugJobId) {
     // fprintf(reportfile, "\n");
     // fprintf(reportfile, "====================\n");
@@ -708,7 +3186,8 @@ static bool doFinalize() {
     // fprintf(reportfile, "====================\n");
     // fprintf(reportfile, "\n");
     
-    if(strcmp(options.debugRDump, "-")) {
+    // replayed pages have no raw page
+    if(strcmp(options.debugRDump, "-") && job->raw != NULL) {
       FILE *drd = fopen(options.debugRDump, "wb");
       for(size_t i = 0; i < job->rawLen; i +=
         fwrite(job->raw + i, 1, job->rawLen - i, drd));
@@ -716,10 +3195,14 @@ static bool doFinalize() {
     }
     
     if(strcmp(options.debugCDump, "-")) {
+      size_t len = (bq_size(&job->compressed) + 7) / 8;
+      uint8_t *buf = (uint8_t*)malloc(len);
+      assert(buf != NULL);
+      bq_copyOut(&job->compressed, buf);
       FILE *dcd = fopen(options.debugCDump, "wb");
-      for(size_t i = 0; i * 8 < job->compressedLen; i += 8 *
-        fwrite(job->compressed + i, 1, (job->compressedLen+7)/8 - i, dcd));
+      for(size_t i = 0; i < len; i += fwrite(buf + i, 1, len - i, dcd));
       fclose(dcd);
+      free(buf);
     }
     
     if(strcmp(options.debugDDump, "-")) {
@@ -729,17 +3212,30 @@ static bool doFinalize() {
       fclose(ddd);
     }
   }
+  reportGuard.unlock();
+  free(stream);
   
-  job->stage = 0;
   job->rawLen = 0;
-  job->compressedLen = 0;
+  bq_clear(&job->compressed);
   job->decompressedLen = 0;
   job->compressorCycles = 0;
   job->decompressorCycles = 0;
-  job->compressorStallCycles = 0;
-  job->decompressorStallCycles = 0;
+  memset(job->compressorCycleKinds, 0, sizeof(job->compressorCycleKinds));
+  memset(job->decompressorCycleKinds, 0, sizeof(job->decompressorCycleKinds));
+  memset(job->compressorShareKinds, 0, sizeof(job->compressorShareKinds));
+  memset(job->decompressorShareKinds, 0, sizeof(job->decompressorShareKinds));
+  memset(job->compressorStageKinds, 0, sizeof(job->compressorStageKinds));
+  job->stratum = -1;
+  job->softError = SD_OK;
+  job->aborted = false;
+  job->sameValue = false;
+  job->duplicate = false;
+  job->collision = false;
+  job->reused = false;
+  // hand the job back to the loader last, once it is fully reset
+  job->stage = 0;
   
-  jobIdx = ++jobIdx % JOB_QUEUE_SIZE;
+  jobIdx = ++jobIdx % options.jobQueueSize;
   
   return true;
 }